@@ -29,10 +29,12 @@
 #include <avr/io.h>
 
 #include "app-io.h"
+#include "app-step.h"
 
 
 static int16_t m_delta;
 static uint8_t m_prev_bits;
+static int8_t m_offset;
 
 
 void app_encoder_reset(void) {
@@ -53,9 +55,6 @@ int16_t app_encoder_delta(void) {
 
 
 void app_encoder_loop(void) {
-    static uint8_t phase;
-    static uint8_t hyst;
-
     // not using PROGMEM because this LUT is small and better off in RAM
     static const int8_t LUT[16] = {
              0,  1, -1,  0,
@@ -73,21 +72,20 @@ void app_encoder_loop(void) {
     dir = LUT[bits | m_prev_bits];
     m_prev_bits = bits << 2;
 
-    // update phase
-    phase = (phase + dir) & 3;
+    // track position relative to last counted detent
+    m_offset += dir;
 
-    // apply hysteresis and update delta
-    if ( phase == 0 && !hyst ) {
-        if ( dir > 0 ) {
-            m_delta++;
-        } else if ( dir < 0 ) {
-            m_delta--;
-        }
+    // count a detent only once the neighbouring detent is reached, so that rocking the wheel part of the way towards
+    // it and back never counts (and jitter on arrival never counts twice)
+    if ( m_offset == 4 || m_offset == -4 ) {
+        dir = (m_offset > 0) ? 1 : -1;
+        m_delta += dir;
+        m_offset = 0;
 
-        hyst = 1;
-    }
-    else if ( phase == 2 ) {
-        hyst = 0;
+#if APP_STEP_STANDALONE
+        // drive step/dir output directly, without waiting for host
+        app_step_detent(dir);
+#endif
     }
 }
 
@@ -99,4 +97,7 @@ void app_encoder_init(void) {
     bits = PINC;
     m_prev_bits = (bits & (1 << APP_IO_C_ENC_AP)) | ((bits & (1 << APP_IO_C_ENC_BP)) >> 1);
     m_prev_bits = m_prev_bits << 2;
+
+    // initial position is taken to be a detent
+    m_offset = 0;
 }
@@ -33,12 +33,32 @@
 // Port B pin assignments
 #define APP_IO_B_AXIS_Z         0
 #define APP_IO_B_AXIS_4         1
+#define APP_IO_B_STEP           2       // stepper driver STEP (OC1B), standalone builds only
+#define APP_IO_B_RS485_DE       3       // RS-485 driver enable (DE and /RE tied), multi-drop builds only
+#define APP_IO_B_DIR            4       // stepper driver DIR, standalone builds only
 #define APP_IO_B_NANO_LED       5
 
-#define APP_IO_B_PORT_INIT      ((1 << 7) | (1 << 6) | (1 << 4) | (1 << 3) | (1 << 2) | \
-                                (1 << APP_IO_B_AXIS_Z) | (1 << APP_IO_B_AXIS_4))
-
-#define APP_IO_B_DDRB_INIT      (1 << APP_IO_B_NANO_LED)
+// outputs that are driven low from the moment port is set up, following the build options passed with -D (an option
+// that is not set reads as 0, its default); unused pins are pulled up instead
+#if APP_SERIAL_MULTIDROP
+// RS-485 driver is held disabled, so that a resetting node never drives the shared bus
+#define APP_IO_B_MULTIDROP_OUTPUTS      (1 << APP_IO_B_RS485_DE)
+#else
+#define APP_IO_B_MULTIDROP_OUTPUTS      0
+#endif
+
+#if APP_STEP_STANDALONE
+// STEP is never pulled high by a reset, which a driver with CMOS inputs would take as a step
+#define APP_IO_B_STANDALONE_OUTPUTS     ((1 << APP_IO_B_STEP) | (1 << APP_IO_B_DIR))
+#else
+#define APP_IO_B_STANDALONE_OUTPUTS     0
+#endif
+
+#define APP_IO_B_PORT_INIT      (((1 << 7) | (1 << 6) | (1 << 4) | (1 << 3) | (1 << 2) | \
+                                (1 << APP_IO_B_AXIS_Z) | (1 << APP_IO_B_AXIS_4)) & \
+                                ~(APP_IO_B_MULTIDROP_OUTPUTS | APP_IO_B_STANDALONE_OUTPUTS))
+
+#define APP_IO_B_DDRB_INIT      ((1 << APP_IO_B_NANO_LED) | APP_IO_B_MULTIDROP_OUTPUTS | APP_IO_B_STANDALONE_OUTPUTS)
 
 
 // Port C pin assignments
@@ -0,0 +1,118 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <avr/io.h>
+#include <avr/power.h>
+
+#include "app-io.h"
+#include "app-led.h"
+#include "app-switch.h"
+
+
+// PWM duty cycle used when MPG LED is on
+#define APP_LED_BRIGHTNESS          0xFF
+
+// TIMER0 overflows (~490Hz) per pattern step (~15.3Hz, 16 steps or ~1s per pattern)
+#define APP_LED_STEP_OVERFLOWS      32
+
+
+static volatile uint8_t m_pattern;
+
+
+void app_led_set_pattern(app_led_pattern_t pattern) {
+    m_pattern = (uint8_t) pattern;
+}
+
+
+void app_led_loop(void) {
+    static uint8_t overflows;
+    static uint8_t index;
+
+    // one bit per step, first byte then second byte; not using PROGMEM because this LUT is small and better off in RAM
+    static const uint8_t PATTERNS[APP_LED_PATTERN_COUNT][2] = {
+            [APP_LED_PATTERN_OFF]           = { 0x00, 0x00 },
+            [APP_LED_PATTERN_ON]            = { 0xFF, 0xFF },
+            [APP_LED_PATTERN_SLOW]          = { 0xFF, 0x00 },
+            [APP_LED_PATTERN_FAST]          = { 0x33, 0x33 },
+            [APP_LED_PATTERN_BUSY]          = { 0x0F, 0x0F },
+            [APP_LED_PATTERN_SOFT_LIMIT]    = { 0x33, 0x00 },
+            [APP_LED_PATTERN_ALARM]         = { 0x55, 0x55 }
+    };
+
+    app_switch_state_t switches;
+    uint8_t pattern;
+
+    // TIMER0 overflow interrupt is left disabled, its flag is only used as a time base
+    if ( !(TIFR0 & (1 << TOV0)) ) {
+        return;
+    }
+
+    TIFR0 = (1 << TOV0);
+
+    if ( ++overflows < APP_LED_STEP_OVERFLOWS ) {
+        return;
+    }
+
+    overflows = 0;
+
+    // advance to next bit of pattern
+    index = (index + 1) & 15;
+
+    if ( !index ) {
+        // toggle Nano LED once per pattern cycle
+        PINB = (1 << APP_IO_B_NANO_LED);
+    }
+
+    pattern = m_pattern;
+
+    if ( pattern == APP_LED_PATTERN_AUTO ) {
+        app_switch_snapshot(&switches);
+
+        // flash slowly in normal mode, quickly in rapid mode and stay off if no axis is selected
+        if ( switches.axis == APP_SWITCH_AXIS_OFF ) {
+            pattern = APP_LED_PATTERN_OFF;
+        } else if ( switches.step == APP_SWITCH_STEP_X1000 ) {
+            pattern = APP_LED_PATTERN_FAST;
+        } else {
+            pattern = APP_LED_PATTERN_SLOW;
+        }
+    }
+
+    // OC0B waveform is generated by TIMER0, so only the duty cycle needs updating
+    OCR0B = (PATTERNS[pattern][index >> 3] & (1 << (index & 7))) ? APP_LED_BRIGHTNESS : 0;
+}
+
+
+void app_led_init(void) {
+    // enable TIMER0
+    power_timer0_enable();
+
+    // configure TIMER0 for phase correct PWM on OC0B (~490Hz, output stays low when OCR0B is zero)
+    OCR0B = 0;
+    TCCR0A = (1 << COM0B1) | (1 << WGM00);
+    TCCR0B = (1 << CS01) | (1 << CS00);
+}
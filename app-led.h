@@ -0,0 +1,71 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * MPG LED and Nano LED control
+ */
+#ifndef _APP_LED_H_
+#define _APP_LED_H_
+
+
+/**
+ * Enumeration of MPG LED patterns.
+ *
+ * Uses:
+ *   TIMER0 (OC0B drives MPG LED)
+ */
+typedef enum {
+    APP_LED_PATTERN_AUTO,       // <-- follows switches (off, slow or fast), default
+    APP_LED_PATTERN_OFF,
+    APP_LED_PATTERN_ON,
+    APP_LED_PATTERN_SLOW,
+    APP_LED_PATTERN_FAST,
+    APP_LED_PATTERN_BUSY,
+    APP_LED_PATTERN_SOFT_LIMIT,
+    APP_LED_PATTERN_ALARM,
+    APP_LED_PATTERN_COUNT
+} app_led_pattern_t;
+
+
+/**
+ * Must be called once with interrupts globally disabled, before main loop begins.
+ */
+void app_led_init(void);
+
+
+/**
+ * Selects pattern shown on MPG LED. APP_LED_PATTERN_AUTO hands control back to the switches.
+ */
+void app_led_set_pattern(app_led_pattern_t pattern);
+
+
+/**
+ * Advances LED patterns when due. To be called from main loop, at least every 2ms.
+ */
+void app_led_loop(void);
+
+#endif // _APP_LED_H_
@@ -25,19 +25,28 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <avr/eeprom.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
 #include <avr/power.h>
+#include <avr/wdt.h>
 
 #include <stdbool.h>
 
 #include "app-encoder.h"
+#include "app-io.h"
+#include "app-led.h"
 #include "app-serial.h"
+#include "app-step.h"
 #include "app-switch.h"
+#include "boot-loader.h"
 
 
 // size of transmit buffer, in bytes
-#define APP_SERIAL_TX_BUFFER_SIZE       16
+#define APP_SERIAL_TX_BUFFER_SIZE       24
+
+// USART0 baud rate divisor (rounded to nearest)
+#define APP_SERIAL_UBRR                 (((F_CPU) + 8UL * (APP_SERIAL_BAUD)) / (16UL * (APP_SERIAL_BAUD)) - 1)
 
 // USART UCSRxB receive configuration
 #define APP_SERIAL_UCSRXB_RECEIVE       ((1 << RXCIE0) | (1 << RXEN0) | (1 << TXEN0))
@@ -45,26 +54,75 @@
 // USART UCSRxB transmit configuration
 #define APP_SERIAL_UCSRXB_TRANSMIT      (APP_SERIAL_UCSRXB_RECEIVE | (1 << UDRIE0))
 
+// standalone step/dir output capability
+#if APP_STEP_STANDALONE
+#define APP_SERIAL_CAPS_STEP            APP_SERIAL_CAP_STEP
+#else
+#define APP_SERIAL_CAPS_STEP            0
+#endif
+
+#if APP_SERIAL_MULTIDROP
+
+// capabilities of this firmware (boot loader is not bus aware, so it cannot be reached over a multi-drop bus)
+#define APP_SERIAL_CAPS                 (APP_SERIAL_CAP_RESET | APP_SERIAL_CAP_STATUS | APP_SERIAL_CAP_IDENT | \
+                                        APP_SERIAL_CAP_LED | APP_SERIAL_CAP_MULTIDROP | APP_SERIAL_CAPS_STEP)
+
+// responses are prefixed by '@' and node address
+#define APP_SERIAL_TX_PREFIX_SIZE       2
+
+// USART UCSRxB configuration while last response character is being shifted out (bus released on completion)
+#define APP_SERIAL_UCSRXB_DRAIN         (APP_SERIAL_UCSRXB_RECEIVE | (1 << TXCIE0))
+
+#else
+
+// capabilities of this firmware
+#define APP_SERIAL_CAPS                 (APP_SERIAL_CAP_RESET | APP_SERIAL_CAP_STATUS | APP_SERIAL_CAP_IDENT | \
+                                        APP_SERIAL_CAP_BOOT | APP_SERIAL_CAP_LED | APP_SERIAL_CAPS_STEP)
+
+// responses are not prefixed
+#define APP_SERIAL_TX_PREFIX_SIZE       0
+
+#endif
+
 
 // enumeration of serial protocol states
 typedef enum {
     APP_SERIAL_STATE_READY,
     APP_SERIAL_STATE_HAVE_RESET_REQ,
     APP_SERIAL_STATE_HAVE_STATUS_REQ,
+    APP_SERIAL_STATE_HAVE_IDENT_REQ,
+    APP_SERIAL_STATE_HAVE_BOOT_REQ,
+    APP_SERIAL_STATE_HAVE_LED_REQ,
+    APP_SERIAL_STATE_HAVE_ADDRESS_REQ,
     APP_SERIAL_STATE_RESPONDING
 } app_serial_state_t;
 
 
 static volatile int8_t m_state;
 static volatile char m_tx_buffer[APP_SERIAL_TX_BUFFER_SIZE];
+static volatile char* const m_tx_frame = &m_tx_buffer[APP_SERIAL_TX_PREFIX_SIZE];
 static volatile uint8_t m_tx_index;
 static volatile uint8_t m_tx_count;
+static bool m_boot_pending;
+static volatile uint8_t m_led_pattern;
+static uint32_t m_serial_number;
+
+#if APP_SERIAL_MULTIDROP
+static volatile char m_node_address;
+static volatile uint8_t m_new_node_address;
+#endif
 
 
 /**
  * USART0 receive complete ISR. Interprets received command characters and modifies module state accordingly.
  */
 ISR(USART_RX_vect) {
+    static char pending_cmd;
+
+#if APP_SERIAL_MULTIDROP
+    static uint8_t addressed;
+#endif
+
     uint8_t flags;
     char cmd;
 
@@ -72,11 +130,63 @@ ISR(USART_RX_vect) {
     flags = UCSR0A;
     cmd = (char) UDR0;
 
+#if APP_SERIAL_MULTIDROP
+    // '@' always starts a new request, so a node that loses sync recovers on the next one
+    if ( cmd == '@' ) {
+        addressed = 1;
+        pending_cmd = 0;
+        return;
+    }
+
+    // character after '@' is node address, requests for other nodes are ignored
+    if ( addressed == 1 ) {
+        addressed = (cmd == m_node_address) ? 2 : 0;
+        return;
+    }
+
+    if ( addressed != 2 ) {
+        return;
+    }
+
+    // stay addressed only if command takes an argument
+    addressed = (pending_cmd == 0 && (cmd == 'L' || cmd == 'A')) ? 2 : 0;
+#endif
+
     // do nothing if not ready for a new command or if a frame error occurred
     if ( m_state != APP_SERIAL_STATE_READY || flags & (1 << FE0) ) {
+        pending_cmd = 0;
         return;
     }
 
+    // interpret argument of two-character command
+    if ( pending_cmd == 'L' ) {
+        pending_cmd = 0;
+
+        if ( cmd >= '0' && cmd < '0' + APP_LED_PATTERN_COUNT ) {
+            m_led_pattern = cmd - '0';
+            m_state = APP_SERIAL_STATE_HAVE_LED_REQ;
+        }
+
+        return;
+    }
+
+#if APP_SERIAL_MULTIDROP
+    // interpret argument of node address command (hex digit)
+    if ( pending_cmd == 'A' ) {
+        pending_cmd = 0;
+
+        if ( cmd >= '0' && cmd <= '9' ) {
+            m_new_node_address = cmd - '0';
+            m_state = APP_SERIAL_STATE_HAVE_ADDRESS_REQ;
+        } else if ( cmd >= 'A' && cmd <= 'F' ) {
+            m_new_node_address = cmd - 'A' + 10;
+            m_state = APP_SERIAL_STATE_HAVE_ADDRESS_REQ;
+        }
+
+        return;
+    }
+#endif
+
     // interpret received command
     switch(cmd) {
     case 'R': // reset request
@@ -87,6 +197,26 @@ ISR(USART_RX_vect) {
         m_state = APP_SERIAL_STATE_HAVE_STATUS_REQ;
         break;
 
+    case 'I': // identify request
+        m_state = APP_SERIAL_STATE_HAVE_IDENT_REQ;
+        break;
+
+#if !APP_SERIAL_MULTIDROP
+    case 'B': // boot loader request
+        m_state = APP_SERIAL_STATE_HAVE_BOOT_REQ;
+        break;
+#endif
+
+    case 'L': // LED pattern request, pattern digit follows
+        pending_cmd = cmd;
+        break;
+
+#if APP_SERIAL_MULTIDROP
+    case 'A': // node address request, address digit follows
+        pending_cmd = cmd;
+        break;
+#endif
+
     default:
         // ignore invalid command characters
         break;
@@ -102,24 +232,48 @@ ISR(USART_UDRE_vect) {
     if ( m_tx_index < m_tx_count ) {
         UDR0 = m_tx_buffer[m_tx_index++];
     } else {
+#if APP_SERIAL_MULTIDROP
+        // last character is still being shifted out, so keep driving bus until transmit completes
+        UCSR0A = (1 << TXC0);
+        UCSR0B = APP_SERIAL_UCSRXB_DRAIN;
+#else
         UCSR0B = APP_SERIAL_UCSRXB_RECEIVE;
+#endif
         m_state = APP_SERIAL_STATE_READY;
     }
 }
 
 
+#if APP_SERIAL_MULTIDROP
+
+/**
+ * USART0 transmit complete ISR. Releases RS-485 bus once last response character has left the shift register.
+ */
+ISR(USART_TX_vect) {
+    PORTB &= ~(1 << APP_IO_B_RS485_DE);
+    UCSR0B = APP_SERIAL_UCSRXB_RECEIVE;
+}
+
+#endif
+
+
 /**
  * Sets module state to 'responding' and initiates response transmission.
  *
- * @param n_chars       Number of characters in transmit buffer to send.
+ * @param n_chars       Number of characters in response frame to send.
  */
 static void send_response(uint8_t n_chars) {
     // enter 'responding' state
     m_state = APP_SERIAL_STATE_RESPONDING;
 
-    // set buffer index and character count
+    // set buffer index and character count (including any prefix)
     m_tx_index = 0;
-    m_tx_count = n_chars;
+    m_tx_count = n_chars + APP_SERIAL_TX_PREFIX_SIZE;
+
+#if APP_SERIAL_MULTIDROP
+    // take RS-485 bus
+    PORTB |= (1 << APP_IO_B_RS485_DE);
+#endif
 
     // begin transmission
     UCSR0B = APP_SERIAL_UCSRXB_TRANSMIT;
@@ -143,8 +297,48 @@ static void uint16_to_hex(volatile char* buffer, uint16_t value) {
 }
 
 
+#if APP_SERIAL_MULTIDROP
+
+/**
+ * Sets address this node answers to on a multi-drop bus.
+ *
+ * @param address       Node address (0x0 - 0xF).
+ */
+static void set_node_address(uint8_t address) {
+    nibble_to_hex(&m_node_address, address);
+
+    // responses are prefixed with node address
+    m_tx_buffer[0] = '@';
+    m_tx_buffer[1] = m_node_address;
+}
+
+#endif
+
+
+/**
+ * Resets device into boot loader once the last response character has been transmitted.
+ *
+ * @note Never returns.
+ */
+static void enter_boot_loader(void) {
+    // wait for last character to leave shift register
+    while ( !(UCSR0A & (1 << TXC0)) ) {
+        // do nothing
+    }
+
+    // let watchdog reset device (boot loader runs first as BOOTRST fuse is programmed)
+    cli();
+    wdt_enable(WDTO_15MS);
+
+    for (;;) {
+        // wait for reset
+    }
+}
+
+
 void app_serial_loop(void) {
     uint16_t enc_delta;
+    app_switch_state_t switch_state;
     uint8_t switch_bits;
 
     // act on current state
@@ -154,11 +348,11 @@ void app_serial_loop(void) {
         app_encoder_reset();
 
         // prepare reset response
-        m_tx_buffer[0] = '[';
-        m_tx_buffer[1] = 'R';
-        m_tx_buffer[2] = ']';
-        m_tx_buffer[3] = '\r';
-        m_tx_buffer[4] = '\n';
+        m_tx_frame[0] = '[';
+        m_tx_frame[1] = 'R';
+        m_tx_frame[2] = ']';
+        m_tx_frame[3] = '\r';
+        m_tx_frame[4] = '\n';
 
         // start transmission
         send_response(5);
@@ -169,25 +363,102 @@ void app_serial_loop(void) {
         enc_delta = (uint16_t) app_encoder_delta();
 
         // encode switch states
-        switch_bits = (uint8_t) app_switch_axis();
-        switch_bits |= ((uint8_t) app_switch_step()) << 3;
-        switch_bits |= app_switch_e_stop() ? (1 << 5) : 0;
+        app_switch_snapshot(&switch_state);
+        switch_bits = switch_state.axis;
+        switch_bits |= switch_state.step << 3;
+        switch_bits |= switch_state.e_stop ? (1 << 5) : 0;
 
         // prepare status response
-        m_tx_buffer[0] = '[';
-        m_tx_buffer[1] = 'S';
+        m_tx_frame[0] = '[';
+        m_tx_frame[1] = 'S';
 
-        uint16_to_hex(&m_tx_buffer[2], enc_delta);
-        uint8_to_hex(&m_tx_buffer[6], switch_bits);
+        uint16_to_hex(&m_tx_frame[2], enc_delta);
+        uint8_to_hex(&m_tx_frame[6], switch_bits);
 
-        m_tx_buffer[8] = ']';
-        m_tx_buffer[9] = '\r';
-        m_tx_buffer[10] = '\n';
+        m_tx_frame[8] = ']';
+        m_tx_frame[9] = '\r';
+        m_tx_frame[10] = '\n';
 
         // start transmission
         send_response(11);
         break;
 
+    case APP_SERIAL_STATE_HAVE_IDENT_REQ:
+        // prepare identify response (version, capabilities and serial number in one frame)
+        m_tx_frame[0] = '[';
+        m_tx_frame[1] = 'I';
+
+        uint16_to_hex(&m_tx_frame[2], APP_SERIAL_VERSION);
+        uint16_to_hex(&m_tx_frame[6], APP_SERIAL_CAPS);
+        uint16_to_hex(&m_tx_frame[10], m_serial_number >> 16);
+        uint16_to_hex(&m_tx_frame[14], m_serial_number & 0xFFFF);
+
+        m_tx_frame[18] = ']';
+        m_tx_frame[19] = '\r';
+        m_tx_frame[20] = '\n';
+
+        // start transmission
+        send_response(21);
+        break;
+
+    case APP_SERIAL_STATE_HAVE_BOOT_REQ:
+        // ask boot loader to wait for an update after reset
+        eeprom_update_byte((uint8_t*) BOOT_LOADER_EE_REQUEST, BOOT_LOADER_REQUEST_MAGIC);
+        m_boot_pending = true;
+
+        // prepare boot response
+        m_tx_frame[0] = '[';
+        m_tx_frame[1] = 'B';
+        m_tx_frame[2] = ']';
+        m_tx_frame[3] = '\r';
+        m_tx_frame[4] = '\n';
+
+        // clear transmit complete flag so that it marks the end of this response
+        UCSR0A = (1 << TXC0);
+
+        // start transmission
+        send_response(5);
+        break;
+
+    case APP_SERIAL_STATE_HAVE_LED_REQ:
+        // select MPG LED pattern
+        app_led_set_pattern((app_led_pattern_t) m_led_pattern);
+
+        // prepare LED response
+        m_tx_frame[0] = '[';
+        m_tx_frame[1] = 'L';
+        m_tx_frame[2] = ']';
+        m_tx_frame[3] = '\r';
+        m_tx_frame[4] = '\n';
+
+        // start transmission
+        send_response(5);
+        break;
+
+#if APP_SERIAL_MULTIDROP
+    case APP_SERIAL_STATE_HAVE_ADDRESS_REQ:
+        // store new node address, which takes effect immediately (including for this response)
+        eeprom_update_byte((uint8_t*) APP_SERIAL_EE_NODE_ADDRESS, m_new_node_address);
+        set_node_address(m_new_node_address);
+
+        // prepare address response
+        m_tx_frame[0] = '[';
+        m_tx_frame[1] = 'A';
+        m_tx_frame[2] = ']';
+        m_tx_frame[3] = '\r';
+        m_tx_frame[4] = '\n';
+
+        // start transmission
+        send_response(5);
+        break;
+#endif
+
+    case APP_SERIAL_STATE_READY:
+        if ( m_boot_pending ) {
+            enter_boot_loader();
+        }
+        break;
+
     default:
         // do nothing
         break;
@@ -196,11 +467,27 @@ void app_serial_loop(void) {
 
 
 void app_serial_init(void) {
+#if APP_SERIAL_MULTIDROP
+    uint8_t address;
+#endif
+
+    // read serial number reported by identify command
+    m_serial_number = eeprom_read_dword((const uint32_t*) APP_SERIAL_EE_SERIAL_NUMBER);
+
     // enable USART0
     power_usart0_enable();
 
-    // configure USART0 (38400 8n1)
-    UBRR0 = 25;
+#if APP_SERIAL_MULTIDROP
+    // read node address (EEPROM setting overrides build default)
+    address = eeprom_read_byte((const uint8_t*) APP_SERIAL_EE_NODE_ADDRESS);
+    set_node_address((address <= 0xF) ? address : APP_SERIAL_NODE_ADDRESS);
+
+    // RS-485 driver is already disabled by app_io_init(), receive line is pulled up while transceiver drives bus
+    PORTD |= (1 << APP_IO_D_RXD);
+#endif
+
+    // configure USART0 (8n1)
+    UBRR0 = APP_SERIAL_UBRR;
     UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
     UCSR0B = APP_SERIAL_UCSRXB_RECEIVE;
 }
@@ -28,6 +28,39 @@
 #ifndef _APP_SERIAL_H_
 #define _APP_SERIAL_H_
 
+// firmware version reported by identify command (major in upper byte, minor in lower byte)
+#define APP_SERIAL_VERSION              0x0102
+
+// capability flags reported by identify command
+#define APP_SERIAL_CAP_RESET            (1 << 0)    // 'R' command
+#define APP_SERIAL_CAP_STATUS           (1 << 1)    // 'S' command
+#define APP_SERIAL_CAP_IDENT            (1 << 2)    // 'I' command
+#define APP_SERIAL_CAP_BOOT             (1 << 3)    // 'B' command and serial boot loader
+#define APP_SERIAL_CAP_LED              (1 << 4)    // 'L' command
+#define APP_SERIAL_CAP_MULTIDROP        (1 << 5)    // addressed RS-485 multi-drop mode
+#define APP_SERIAL_CAP_STEP             (1 << 6)    // standalone step/dir output
+
+// EEPROM location of 32-bit serial number (0xFFFFFFFF if not programmed)
+#define APP_SERIAL_EE_SERIAL_NUMBER     0x000
+
+// EEPROM location of multi-drop node address (0x0 - 0xF, APP_SERIAL_NODE_ADDRESS is used if not programmed)
+#define APP_SERIAL_EE_NODE_ADDRESS      0x004
+
+// serial baud rate
+#ifndef APP_SERIAL_BAUD
+#define APP_SERIAL_BAUD                 38400
+#endif
+
+// non-zero to build for addressed RS-485 multi-drop operation
+#ifndef APP_SERIAL_MULTIDROP
+#define APP_SERIAL_MULTIDROP            0
+#endif
+
+// default multi-drop node address (0x0 - 0xF)
+#ifndef APP_SERIAL_NODE_ADDRESS
+#define APP_SERIAL_NODE_ADDRESS         1
+#endif
+
 
 /**
  * Initialises module. Must be called once with interrupts globally disabled, before main loop begins.
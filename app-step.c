@@ -0,0 +1,282 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include <stdbool.h>
+
+#include "app-io.h"
+#include "app-step.h"
+#include "app-switch.h"
+
+#if APP_STEP_STANDALONE
+
+// TIMER1 count rate (prescaler is set by app_switch_init())
+#define APP_STEP_TICK_HZ                ((F_CPU) / 8UL)
+
+// shortest step period, in timer ticks
+#define APP_STEP_MIN_INTERVAL           (APP_STEP_TICK_HZ / (APP_STEP_MAX_RATE))
+
+// square of first step period from rest, in timer ticks (c0 = 0.676 * f * sqrt(2 / a), see D. Austin, "Generate
+// stepper-motor speed profiles in real time", Embedded Systems Programming, January 2005)
+#define APP_STEP_C0_SQUARED             (914ULL * APP_STEP_TICK_HZ * APP_STEP_TICK_HZ / 1000ULL / (APP_STEP_ACCEL))
+
+// delay from starting output at rest to first rising edge, in timer ticks (10us, covers DIR setup time)
+#define APP_STEP_START_DELAY            20
+
+// least time between writing OCR1B and the edge it schedules, in timer ticks (2us, covers the write itself)
+#define APP_STEP_MIN_LEAD               4
+
+// limits on step period and ramp length that keep ramp arithmetic within 16 bits
+#define APP_STEP_MAX_INTERVAL           16383
+#define APP_STEP_MAX_RAMP               8191
+
+// each edge leaves 40us for the handler, which may first wait for the switch poll or a serial interrupt to finish
+#if APP_STEP_MIN_INTERVAL < 160
+#error "APP_STEP_MAX_RATE is too high (interrupt handler needs at least 40us per step edge, at most 12500 steps/s)"
+#endif
+
+#if APP_STEP_C0_SQUARED > (APP_STEP_MAX_INTERVAL * APP_STEP_MAX_INTERVAL)
+#error "APP_STEP_ACCEL is too low (first step period exceeds ramp arithmetic range)"
+#endif
+
+#if (APP_STEP_MAX_RATE) * (APP_STEP_MAX_RATE) / (2 * (APP_STEP_ACCEL)) > APP_STEP_MAX_RAMP
+#error "APP_STEP_ACCEL is too low for APP_STEP_MAX_RATE (ramp is too long)"
+#endif
+
+
+static uint16_t m_c0;
+static volatile int32_t m_pending;
+static volatile uint16_t m_n;
+static volatile int8_t m_dir;
+static uint16_t m_interval;
+static uint16_t m_rest;
+static bool m_high;
+
+
+/**
+ * Plans next step. Speed is tracked as ramp step count n (steps taken to reach current speed from rest, which is
+ * also the number of steps needed to stop), with each step period derived from the previous one.
+ *
+ * @return  True if another step is to be output, false if output has come to rest.
+ */
+static bool plan_step(void) {
+    int32_t pending = m_pending;
+    uint16_t div;
+    uint16_t d;
+
+    // speed after first step is slow enough to stop (or reverse) without further deceleration
+    if ( m_n == 1 && pending * m_dir <= 0 ) {
+        m_n = 0;
+    }
+
+    if ( m_n == 0 ) {
+        if ( pending == 0 ) {
+            return false;
+        }
+
+        // start from rest (DIR is set at least APP_STEP_START_DELAY ahead of first rising edge)
+        if ( pending > 0 ) {
+            m_dir = 1;
+            PORTB |= (1 << APP_IO_B_DIR);
+        } else {
+            m_dir = -1;
+            PORTB &= ~(1 << APP_IO_B_DIR);
+        }
+
+        m_n = 1;
+        m_interval = m_c0;
+        m_rest = 0;
+    } else if ( pending * m_dir > m_n ) {
+        // accelerate until maximum rate is reached, then cruise
+        if ( m_interval > APP_STEP_MIN_INTERVAL && m_n < APP_STEP_MAX_RAMP ) {
+            div = 4 * m_n + 1;
+            d = 2 * m_interval + m_rest;
+            m_interval -= d / div;
+            m_rest = d % div;
+            m_n++;
+
+            if ( m_interval < APP_STEP_MIN_INTERVAL ) {
+                m_interval = APP_STEP_MIN_INTERVAL;
+            }
+        }
+    } else {
+        // decelerate so as to stop on target (steps beyond target are taken back after stopping)
+        m_n--;
+
+        if ( m_n > 0 ) {
+            div = 4 * m_n - 1;
+            d = 2 * m_interval + m_rest;
+            m_interval += d / div;
+            m_rest = d % div;
+        }
+
+        if ( m_n == 0 || m_interval > m_c0 ) {
+            m_interval = m_c0;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * Starts step output from rest. Must be called with interrupts disabled.
+ */
+static void start_output(void) {
+    if ( !plan_step() ) {
+        return;
+    }
+
+    // first step is output straight away, OC1B toggles on each compare match from then on
+    m_high = false;
+    OCR1B = TCNT1 + APP_STEP_START_DELAY;
+    TIFR1 = (1 << OCF1B);
+    TCCR1A = (1 << COM1B0);
+    TIMSK1 |= (1 << OCIE1B);
+}
+
+
+/**
+ * TIMER1 compare B ISR. Runs after each STEP edge (generated in hardware) and schedules the next one.
+ */
+ISR(TIMER1_COMPB_vect) {
+    uint16_t next;
+
+    m_high = !m_high;
+
+    if ( m_high ) {
+        // rising edge has been output, hold STEP high for remainder of step period
+        m_pending -= m_dir;
+        next = OCR1B + (m_interval - (m_interval >> 1));
+    } else if ( plan_step() ) {
+        // schedule rising edge of next step
+        next = OCR1B + (m_interval >> 1);
+    } else {
+        // at rest, disconnect STEP from timer (leaves pin low)
+        TCCR1A = 0;
+        TIMSK1 &= ~(1 << OCIE1B);
+        return;
+    }
+
+    // if handler was held up past the next edge time, match would only come after TIMER1 wraps (~33ms), so output the
+    // edge late instead (this only ever lengthens a step period)
+    if ( (int16_t) (next - TCNT1) < APP_STEP_MIN_LEAD ) {
+        next = TCNT1 + APP_STEP_MIN_LEAD;
+    }
+
+    OCR1B = next;
+}
+
+
+/**
+ * @return  Integer square root of value.
+ */
+static uint16_t isqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+
+    while ( bit > value ) {
+        bit >>= 2;
+    }
+
+    while ( bit ) {
+        if ( value >= root + bit ) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+
+        bit >>= 2;
+    }
+
+    return (uint16_t) root;
+}
+
+
+void app_step_detent(int8_t dir) {
+    static const uint16_t SCALE[4] = { 1, 10, 100, 1000 };
+
+    app_switch_state_t state;
+    int32_t steps;
+    int32_t pending;
+
+    app_switch_snapshot(&state);
+
+    // wheel drives output only while its axis is selected, and never while e-stop is pressed
+    if ( state.axis != APP_STEP_AXIS || state.e_stop ) {
+        return;
+    }
+
+    steps = (int32_t) SCALE[state.step] * APP_STEP_PER_DETENT;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pending = m_pending + ((dir > 0) ? steps : -steps);
+
+        if ( pending > APP_STEP_MAX_PENDING ) {
+            pending = APP_STEP_MAX_PENDING;
+        } else if ( pending < -APP_STEP_MAX_PENDING ) {
+            pending = -APP_STEP_MAX_PENDING;
+        }
+
+        m_pending = pending;
+
+        // start output if at rest (otherwise ISR picks up new target on next step)
+        if ( !(TIMSK1 & (1 << OCIE1B)) ) {
+            start_output();
+        }
+    }
+}
+
+
+void app_step_loop(void) {
+    app_switch_state_t state;
+
+    app_switch_snapshot(&state);
+
+    // on e-stop, drop queued steps and come to rest as quickly as deceleration allows
+    if ( state.e_stop ) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            m_pending = (int32_t) m_dir * m_n;
+        }
+    }
+}
+
+
+void app_step_init(void) {
+    // STEP and DIR are already low outputs, set up by app_io_init()
+
+    // TIMER1 stays in normal mode, OC1B is only connected while stepping
+    TCCR1A = 0;
+
+    m_c0 = isqrt(APP_STEP_C0_SQUARED);
+}
+
+#endif // APP_STEP_STANDALONE
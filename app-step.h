@@ -0,0 +1,91 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Standalone step/dir output
+ */
+#ifndef _APP_STEP_H_
+#define _APP_STEP_H_
+
+#include <stdint.h>
+
+// non-zero to build with step/dir output driven directly from the wheel (STEP on D10, DIR on D12)
+#ifndef APP_STEP_STANDALONE
+#define APP_STEP_STANDALONE             0
+#endif
+
+// axis select switch position (app_switch_axis_t) that routes the wheel to the step/dir output
+#ifndef APP_STEP_AXIS
+#define APP_STEP_AXIS                   1
+#endif
+
+// steps per wheel detent at x1 (multiplied by 10, 100 or 1000 at the other step settings)
+#ifndef APP_STEP_PER_DETENT
+#define APP_STEP_PER_DETENT             1
+#endif
+
+// maximum step rate (steps/s, at most 12500)
+#ifndef APP_STEP_MAX_RATE
+#define APP_STEP_MAX_RATE               10000
+#endif
+
+// acceleration and deceleration (steps/s^2)
+#ifndef APP_STEP_ACCEL
+#define APP_STEP_ACCEL                  50000
+#endif
+
+// maximum number of steps queued ahead of the output (further detents are dropped)
+#ifndef APP_STEP_MAX_PENDING
+#define APP_STEP_MAX_PENDING            20000
+#endif
+
+
+/**
+ * Initialises module. Must be called once with interrupts globally disabled, after app_switch_init() and before
+ * main loop begins.
+ *
+ * Uses:
+ *   TIMER1 (OC1B drives STEP, shares timer with switch polling)
+ */
+void app_step_init(void);
+
+
+/**
+ * Queues steps for one wheel detent, scaled by selected step size. Ignored unless APP_STEP_AXIS is selected. To be
+ * called by encoder module as each detent is decoded.
+ *
+ * @param dir       Detent direction (1 or -1).
+ */
+void app_step_detent(int8_t dir);
+
+
+/**
+ * To be called on each iteration of main loop.
+ */
+void app_step_loop(void);
+
+#endif // _APP_STEP_H_
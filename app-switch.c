@@ -33,25 +33,16 @@
 #include "app-switch.h"
 
 
-// MPG LED slow flash rate
-#define APP_SELECT_SLOW_FLASH           15
-
-// MPG LED fast flash rate
-#define APP_SELECT_FAST_FLASH           4
-
-
-static volatile uint8_t m_e_stop_state;
-static volatile uint8_t m_axis;
-static volatile uint8_t m_step;
+// double-buffered switch state, m_sequence & 1 selects the slot last published by the ISR
+static volatile app_switch_state_t m_states[2];
+static volatile uint8_t m_sequence;
 
 
 /**
- * TIMER1 overflow ISR. Flashes MPG LED.
+ * TIMER1 overflow ISR. Polls switches.
  */
 ISR(TIMER1_OVF_vect) {
-    static uint8_t flash_div;
-
-    uint8_t flash_rate;
+    volatile app_switch_state_t* state;
     uint8_t portb_bits;
     uint8_t portc_bits;
     uint8_t portd_bits;
@@ -61,75 +52,55 @@ ISR(TIMER1_OVF_vect) {
     portc_bits = PINC;
     portd_bits = PIND;
 
+    // fill slot not currently published, so that a reader part way through a copy of the other slot is unaffected
+    state = &m_states[(m_sequence + 1) & 1];
+
     // decode e-stop state
-    m_e_stop_state = (portd_bits & (1 << APP_IO_D_ESTOP)) != 0;
+    state->e_stop = (portd_bits & (1 << APP_IO_D_ESTOP)) != 0;
 
     // decode step selection (rotary switch + rapid button)
     if ( portd_bits & (1 << APP_IO_D_RAPID) ) {
-        // use slow MPG LED flash rate if in normal mode
-        flash_rate = APP_SELECT_SLOW_FLASH;
-
         // decode step size
         if ( !(portd_bits & (1 << APP_IO_D_X10)) ) {
-            m_step = APP_SWITCH_STEP_X10;
+            state->step = APP_SWITCH_STEP_X10;
         } else if ( !(portd_bits & (1 << APP_IO_D_X100)) ) {
-            m_step = APP_SWITCH_STEP_X100;
+            state->step = APP_SWITCH_STEP_X100;
         } else {
-            m_step = APP_SWITCH_STEP_X1;
+            state->step = APP_SWITCH_STEP_X1;
         }
     } else {
         // use x1000 step size if rapid button is pressed
-        m_step = APP_SWITCH_STEP_X1000;
-
-        // use fast MPG LED flash rate if in rapid mode
-        flash_rate = APP_SELECT_FAST_FLASH;
+        state->step = APP_SWITCH_STEP_X1000;
     }
 
     if ( !(portc_bits & (1 << APP_IO_C_AXIS_X)) ) {
-        m_axis = APP_SWITCH_AXIS_X;
+        state->axis = APP_SWITCH_AXIS_X;
     } else if ( !(portc_bits & (1 << APP_IO_C_AXIS_Y)) ) {
-        m_axis = APP_SWITCH_AXIS_Y;
+        state->axis = APP_SWITCH_AXIS_Y;
     } else if ( !(portb_bits & (1 << APP_IO_B_AXIS_Z)) ) {
-        m_axis = APP_SWITCH_AXIS_Z;
+        state->axis = APP_SWITCH_AXIS_Z;
     } else if ( !(portb_bits & (1 << APP_IO_B_AXIS_4)) ) {
-        m_axis = APP_SWITCH_AXIS_4;
+        state->axis = APP_SWITCH_AXIS_4;
     } else {
-        m_axis = APP_SWITCH_AXIS_OFF;
-
-        // force MPG LED off if no axis is selected
-        flash_rate = 0;
+        state->axis = APP_SWITCH_AXIS_OFF;
     }
 
-    // flash MPG LED
-    flash_div++;
-
-    if (flash_rate == 0 ) {
-        // ensure MPG LED is off if toggle rate is zero
-        if ( PORTD & (1 << APP_IO_D_MPG_LED) ) {
-            PIND = (1 << APP_IO_D_MPG_LED);
-        }
-    } else if (flash_div >= flash_rate ) {
-        // toggle MPG LED state
-        PIND = (1 << APP_IO_D_MPG_LED);
-
-        // reset flash division counter
-        flash_div = 0;
-    }
+    // publish new state
+    m_sequence++;
 }
 
 
-bool app_switch_e_stop(void) {
-    return m_e_stop_state;
-}
-
-
-app_switch_axis_t app_switch_axis(void) {
-    return (app_switch_axis_t) m_axis;
-}
+void app_switch_snapshot(app_switch_state_t* state) {
+    uint8_t sequence;
 
+    // ISR only ever writes the unpublished slot, so the copy is coherent unless the ISR ran twice during it
+    do {
+        sequence = m_sequence;
 
-app_switch_step_t app_switch_step(void) {
-    return (app_switch_step_t) m_step;
+        state->axis = m_states[sequence & 1].axis;
+        state->step = m_states[sequence & 1].step;
+        state->e_stop = m_states[sequence & 1].e_stop;
+    } while ( (uint8_t) (m_sequence - sequence) > 1 );
 }
 
 
@@ -26,12 +26,13 @@
  */
 
 /**
- * Selector switch polling and MPG LED control
+ * Selector switch polling
  */
 #ifndef _APP_SWITCH_H_
 #define _APP_SWITCH_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 
 /**
@@ -61,26 +62,27 @@ typedef enum {
 
 
 /**
- * Must be called once with interrupts globally disabled, before main loop begins.
+ * Switch state captured by a single poll.
  */
-void app_switch_init(void);
+typedef struct {
+    uint8_t axis;       // app_switch_axis_t
+    uint8_t step;       // app_switch_step_t
+    bool e_stop;
+} app_switch_state_t;
 
 
 /**
- * @return  True if e-stop switch is pressed.
- */
-bool app_switch_e_stop(void);
-
-
-/**
- * @return  Axis select switch position.
+ * Must be called once with interrupts globally disabled, before main loop begins.
  */
-app_switch_axis_t app_switch_axis(void);
+void app_switch_init(void);
 
 
 /**
- * @return  Step select switch position.
+ * Takes a coherent copy of the most recently polled switch state (all fields come from the same poll). Does not
+ * disable interrupts.
+ *
+ * @param state     Destination for switch state.
  */
-app_switch_step_t app_switch_step(void);
+void app_switch_snapshot(app_switch_state_t* state);
 
 #endif // _APP_SWITCH_H_
@@ -0,0 +1,396 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <avr/boot.h>
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/wdt.h>
+#include <util/crc16.h>
+
+#include <stdbool.h>
+
+#include "boot-loader.h"
+
+
+#define EE_REQUEST          ((uint8_t*) BOOT_LOADER_EE_REQUEST)
+#define EE_COMMIT           ((uint8_t*) BOOT_LOADER_EE_COMMIT)
+#define EE_APP_LENGTH       ((uint16_t*) BOOT_LOADER_EE_APP_LENGTH)
+#define EE_APP_CRC          ((uint16_t*) BOOT_LOADER_EE_APP_CRC)
+#define EE_STAGE_LENGTH     ((uint16_t*) BOOT_LOADER_EE_STAGE_LENGTH)
+#define EE_STAGE_CRC        ((uint16_t*) BOOT_LOADER_EE_STAGE_CRC)
+
+// listen window in TIMER1 ticks (prescaler 1024)
+#define LISTEN_TICKS        ((uint16_t) ((F_CPU) / 1024UL * (BOOT_LOADER_LISTEN_MS) / 1000UL))
+
+
+static uint8_t m_page[BOOT_LOADER_PAGE_SIZE];
+
+
+static uint8_t uart_get(void) {
+    while ( !(UCSR0A & (1 << RXC0)) ) {
+        // wait for character (watchdog resets device if host goes away)
+    }
+
+    return UDR0;
+}
+
+
+static uint16_t uart_get16(void) {
+    uint16_t value;
+
+    value = uart_get();
+    value |= ((uint16_t) uart_get()) << 8;
+
+    return value;
+}
+
+
+static void uart_put(uint8_t c) {
+    while ( !(UCSR0A & (1 << UDRE0)) ) {
+        // wait for space in transmit register
+    }
+
+    UDR0 = c;
+}
+
+
+static void uart_put16(uint16_t value) {
+    uart_put(value & 0xFF);
+    uart_put(value >> 8);
+}
+
+
+static uint16_t flash_crc(uint16_t addr, uint16_t length) {
+    uint16_t crc = 0;
+
+    while ( length-- ) {
+        crc = _crc_xmodem_update(crc, pgm_read_byte(addr++));
+    }
+
+    return crc;
+}
+
+
+/**
+ * Programs one flash page from m_page. Page is left untouched if it already holds the same data, which saves both
+ * time and flash endurance when only a few pages of an image change.
+ *
+ * @param addr          Page-aligned byte address.
+ */
+static void flash_write_page(uint16_t addr) {
+    uint8_t i;
+
+    for (i = 0; i < BOOT_LOADER_PAGE_SIZE; i++) {
+        if ( pgm_read_byte(addr + i) != m_page[i] ) {
+            break;
+        }
+    }
+
+    if ( i == BOOT_LOADER_PAGE_SIZE ) {
+        return;
+    }
+
+    eeprom_busy_wait();
+
+    boot_page_erase(addr);
+    boot_spm_busy_wait();
+
+    for (i = 0; i < BOOT_LOADER_PAGE_SIZE; i += 2) {
+        boot_page_fill(addr + i, m_page[i] | (((uint16_t) m_page[i + 1]) << 8));
+    }
+
+    boot_page_write(addr);
+    boot_spm_busy_wait();
+    boot_rww_enable();
+}
+
+
+/**
+ * Copies pages from one flash region to another. Pages at or beyond src_length are filled with 0xFF.
+ */
+static void flash_copy(uint16_t dst, uint16_t src, uint16_t src_length, uint16_t length) {
+    uint16_t offset;
+    uint8_t i;
+
+    for (offset = 0; offset < length; offset += BOOT_LOADER_PAGE_SIZE) {
+        for (i = 0; i < BOOT_LOADER_PAGE_SIZE; i++) {
+            m_page[i] = (offset + i < src_length) ? pgm_read_byte(src + offset + i) : 0xFF;
+        }
+
+        flash_write_page(dst + offset);
+        wdt_reset();
+    }
+}
+
+
+/**
+ * Copies staged image to application region. Commit flag is held in EEPROM for the duration of the copy so that an
+ * interrupted commit is completed on next reset. The new length and CRC are only moved to the application slots once
+ * the copy is complete, so the old image stays valid if power is lost before the flag is set.
+ */
+static void commit(void) {
+    uint16_t length;
+
+    eeprom_update_byte(EE_COMMIT, BOOT_LOADER_COMMIT_MAGIC);
+
+    length = eeprom_read_word(EE_STAGE_LENGTH);
+    flash_copy(BOOT_LOADER_APP_START, BOOT_LOADER_STAGE_START, BOOT_LOADER_APP_SIZE,
+               (length + BOOT_LOADER_PAGE_SIZE - 1) & ~(BOOT_LOADER_PAGE_SIZE - 1));
+
+    eeprom_update_word(EE_APP_LENGTH, length);
+    eeprom_update_word(EE_APP_CRC, eeprom_read_word(EE_STAGE_CRC));
+    eeprom_update_byte(EE_COMMIT, 0xFF);
+}
+
+
+/**
+ * @return  True if application region holds a runnable image.
+ */
+static bool app_valid(void) {
+    uint16_t length;
+
+    // erased reset vector means there is nothing to run
+    if ( pgm_read_word(BOOT_LOADER_APP_START) == 0xFFFF ) {
+        return false;
+    }
+
+    // image programmed by ISP has no recorded length, so trust it
+    length = eeprom_read_word(EE_APP_LENGTH);
+
+    if ( length == 0xFFFF ) {
+        return true;
+    }
+
+    return length <= BOOT_LOADER_APP_SIZE &&
+           flash_crc(BOOT_LOADER_APP_START, length) == eeprom_read_word(EE_APP_CRC);
+}
+
+
+/**
+ * Waits for watchdog to reset device. Used to leave boot loader with all peripherals in their reset state.
+ */
+static void reset(void) {
+    wdt_enable(WDTO_15MS);
+
+    for (;;) {
+        // wait for reset
+    }
+}
+
+
+/**
+ * Waits briefly for the host to send the wake-up sequence. Gives the host a way in after a reset (e.g. by DTR when the
+ * port is opened) even if the application cannot be asked to enter the boot loader. A single command byte is not
+ * enough, as the application's identify command is also 'I' and is sent by discovery straight after opening a port.
+ *
+ * @return  True if wake-up sequence was received.
+ */
+static bool listen(void) {
+    static const char SYNC[] = BOOT_LOADER_SYNC;
+    uint8_t matched = 0;
+    uint8_t c;
+
+    TCCR1B = (1 << CS12) | (1 << CS10);
+
+    while ( TCNT1 < LISTEN_TICKS && matched < BOOT_LOADER_SYNC_LENGTH ) {
+        if ( UCSR0A & (1 << RXC0) ) {
+            c = UDR0;
+
+            if ( c == (uint8_t) SYNC[matched] ) {
+                matched++;
+            } else {
+                matched = (c == (uint8_t) SYNC[0]) ? 1 : 0;
+            }
+        }
+    }
+
+    TCCR1B = 0;
+    TCNT1 = 0;
+
+    return matched == BOOT_LOADER_SYNC_LENGTH;
+}
+
+
+/**
+ * Starts application with USART0 returned to its reset state.
+ *
+ * @note Never returns.
+ */
+static void run_app(void) {
+    UCSR0B = 0;
+    UCSR0A = 0;
+    UBRR0 = 0;
+
+    ((void (*)(void)) BOOT_LOADER_APP_START)();
+}
+
+
+static void handle_write(void) {
+    uint16_t crc = 0;
+    uint8_t page;
+    uint8_t i;
+
+    page = uart_get();
+
+    for (i = 0; i < BOOT_LOADER_PAGE_SIZE; i++) {
+        m_page[i] = uart_get();
+        crc = _crc_xmodem_update(crc, m_page[i]);
+    }
+
+    if ( uart_get16() != crc || page >= BOOT_LOADER_APP_PAGES ) {
+        uart_put(BOOT_LOADER_NAK);
+        return;
+    }
+
+    flash_write_page(BOOT_LOADER_STAGE_START + ((uint16_t) page) * BOOT_LOADER_PAGE_SIZE);
+    uart_put(BOOT_LOADER_ACK);
+}
+
+
+static void handle_commit(void) {
+    uint16_t length;
+    uint16_t crc;
+
+    length = uart_get16();
+    crc = uart_get16();
+
+    // application region is left untouched unless staged image is intact
+    if ( length > BOOT_LOADER_APP_SIZE || flash_crc(BOOT_LOADER_STAGE_START, length) != crc ) {
+        uart_put(BOOT_LOADER_NAK);
+        return;
+    }
+
+    eeprom_update_word(EE_STAGE_LENGTH, length);
+    eeprom_update_word(EE_STAGE_CRC, crc);
+    commit();
+    uart_put(BOOT_LOADER_ACK);
+}
+
+
+/**
+ * Boot loader entry point. Runs application unless it has requested an update, is not valid or the host sends the
+ * wake-up sequence within BOOT_LOADER_LISTEN_MS of an external or power-on reset.
+ *
+ * @note Never returns.
+ */
+int main(void) {
+    uint16_t length;
+    uint8_t reset_flags;
+    bool requested;
+
+    // application leaves watchdog running, so stop it before doing anything lengthy
+    reset_flags = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+
+    // finish any commit that was interrupted by a reset or power loss
+    if ( eeprom_read_byte(EE_COMMIT) == BOOT_LOADER_COMMIT_MAGIC ) {
+        commit();
+    }
+
+    // configure USART0 (500000 8n1), polled
+    UBRR0 = BOOT_LOADER_UBRR;
+    UCSR0A = (1 << U2X0);
+    UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+    UCSR0B = (1 << RXEN0) | (1 << TXEN0);
+
+    // consume update request
+    requested = eeprom_read_byte(EE_REQUEST) == BOOT_LOADER_REQUEST_MAGIC;
+
+    if ( requested ) {
+        eeprom_update_byte(EE_REQUEST, 0xFF);
+    } else if ( app_valid() ) {
+        // resets from the watchdog (application or boot loader exit) and brown-out go straight to the application
+        if ( !(reset_flags & ((1 << EXTRF) | (1 << PORF))) || !listen() ) {
+            run_app();
+        }
+    }
+
+    // return to application if host stops talking
+    wdt_enable(WDTO_2S);
+
+    for (;;) {
+        switch(uart_get()) {
+        case BOOT_LOADER_CMD_INFO:
+            uart_put(BOOT_LOADER_ACK);
+            uart_put(BOOT_LOADER_VERSION);
+            uart_put(BOOT_LOADER_PAGE_SIZE);
+            uart_put(BOOT_LOADER_APP_PAGES);
+            break;
+
+        case BOOT_LOADER_CMD_VERIFY:
+            length = uart_get16();
+
+            if ( length > BOOT_LOADER_APP_SIZE ) {
+                uart_put(BOOT_LOADER_NAK);
+            } else {
+                uart_put(BOOT_LOADER_ACK);
+                uart_put16(flash_crc(BOOT_LOADER_APP_START, length));
+            }
+            break;
+
+        case BOOT_LOADER_CMD_OPEN:
+            // seed staging area with current image so that a delta only needs to send changed pages
+            length = uart_get16();
+
+            if ( length > BOOT_LOADER_APP_SIZE ) {
+                uart_put(BOOT_LOADER_NAK);
+            } else {
+                flash_copy(BOOT_LOADER_STAGE_START, BOOT_LOADER_APP_START, length, BOOT_LOADER_APP_SIZE);
+                uart_put(BOOT_LOADER_ACK);
+            }
+            break;
+
+        case BOOT_LOADER_CMD_WRITE:
+            handle_write();
+            break;
+
+        case BOOT_LOADER_CMD_COMMIT:
+            handle_commit();
+            break;
+
+        case BOOT_LOADER_CMD_EXIT:
+            // clear transmit complete flag so that it marks the end of the acknowledgement
+            UCSR0A = (1 << U2X0) | (1 << TXC0);
+            uart_put(BOOT_LOADER_ACK);
+
+            while ( !(UCSR0A & (1 << TXC0)) ) {
+                // wait for acknowledgement to leave shift register
+            }
+
+            reset();
+            break;
+
+        default:
+            // ignore unknown commands
+            continue;
+        }
+
+        wdt_reset();
+    }
+}
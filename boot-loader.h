@@ -0,0 +1,96 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Serial boot loader definitions, shared by the boot loader, the application and host tools.
+ *
+ * Flash layout (ATmega328P, 128 byte pages):
+ *
+ *   0x0000 - 0x37FF    Application image
+ *   0x3800 - 0x6FFF    Staging area (new image is assembled and verified here before being committed)
+ *   0x7000 - 0x7FFF    Boot loader (BOOTSZ = 2048 words, BOOTRST programmed)
+ */
+#ifndef _BOOT_LOADER_H_
+#define _BOOT_LOADER_H_
+
+// boot loader protocol version
+#define BOOT_LOADER_VERSION             1
+
+// flash page size, in bytes
+#define BOOT_LOADER_PAGE_SIZE           128
+
+// application region start address and size, in bytes
+#define BOOT_LOADER_APP_START           0x0000
+#define BOOT_LOADER_APP_SIZE            0x3800
+
+// staging region start address
+#define BOOT_LOADER_STAGE_START         0x3800
+
+// boot loader start address (byte address, as passed to linker)
+#define BOOT_LOADER_START               0x7000
+
+// number of pages in application region
+#define BOOT_LOADER_APP_PAGES           (BOOT_LOADER_APP_SIZE / BOOT_LOADER_PAGE_SIZE)
+
+
+// EEPROM locations (top of EEPROM is reserved for boot loader)
+#define BOOT_LOADER_EE_REQUEST          0x3F8   // uint8_t, set to BOOT_LOADER_REQUEST_MAGIC by application
+#define BOOT_LOADER_EE_COMMIT           0x3F9   // uint8_t, BOOT_LOADER_COMMIT_MAGIC while commit is in progress
+#define BOOT_LOADER_EE_APP_LENGTH       0x3FA   // uint16_t, length of committed image (0xFFFF if unknown)
+#define BOOT_LOADER_EE_APP_CRC          0x3FC   // uint16_t, CRC of committed image
+#define BOOT_LOADER_EE_STAGE_LENGTH     0x3F4   // uint16_t, length of image being committed
+#define BOOT_LOADER_EE_STAGE_CRC        0x3F6   // uint16_t, CRC of image being committed
+
+#define BOOT_LOADER_REQUEST_MAGIC       0xB0
+#define BOOT_LOADER_COMMIT_MAGIC        0xC0
+
+
+// boot loader serial configuration (500000 baud 8n1, U2X0 set)
+#define BOOT_LOADER_BAUD                500000
+#define BOOT_LOADER_UBRR                3
+
+// time boot loader listens for the wake-up sequence after an external or power-on reset, in milliseconds
+#define BOOT_LOADER_LISTEN_MS           250
+
+// wake-up sequence accepted during listen window (never sent by the application protocol, which is all ASCII, and
+// first byte does not recur within it)
+#define BOOT_LOADER_SYNC                "\xA5\x5A\xC3\x3C"
+#define BOOT_LOADER_SYNC_LENGTH         4
+
+
+// boot loader commands (all multi-byte values are little-endian, all CRCs are CRC-16/XMODEM)
+#define BOOT_LOADER_CMD_INFO            'I'     // -> ACK, version, page size, app pages
+#define BOOT_LOADER_CMD_VERIFY          'V'     // length16 -> ACK, crc16 of application region
+#define BOOT_LOADER_CMD_OPEN            'O'     // base_length16 -> ACK (stage seeded from application)
+#define BOOT_LOADER_CMD_WRITE           'W'     // page8, data[PAGE_SIZE], crc16 -> ACK/NAK
+#define BOOT_LOADER_CMD_COMMIT          'C'     // length16, crc16 -> ACK/NAK
+#define BOOT_LOADER_CMD_EXIT            'X'     // -> ACK, then reset into application
+
+#define BOOT_LOADER_ACK                 'K'
+#define BOOT_LOADER_NAK                 'E'
+
+#endif // _BOOT_LOADER_H_
@@ -0,0 +1,244 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mpg-bus-sim.h"
+
+
+static uint32_t next_random(mpg_bus_sim_t* sim) {
+    sim->lcg = sim->lcg * 1103515245u + 12345u;
+
+    return sim->lcg >> 8;
+}
+
+
+/**
+ * Operator picks up or puts down a pendant: an axis is selected with some wheel speed, or the pendant is left idle.
+ */
+static void change_operator(mpg_bus_sim_t* sim, mpg_bus_sim_node_t* node) {
+    uint32_t r = next_random(sim);
+
+    if ( r % 3 == 0 ) {
+        node->axis = 0;
+        node->wheel_rate = 0.0;
+    } else {
+        node->axis = (uint8_t) (1 + r % 4);
+        node->step = (uint8_t) ((r >> 4) % 4);
+        node->wheel_rate = (double) ((int) ((r >> 8) % 401) - 200);
+    }
+
+    node->next_change_us = sim->now_us + 100000.0 + (double) (next_random(sim) % 900000);
+}
+
+
+/**
+ * Advances virtual clock, turning wheels as time passes.
+ */
+static void advance(mpg_bus_sim_t* sim, double until_us) {
+    mpg_bus_sim_node_t* node;
+    double dt;
+    int i;
+
+    if ( until_us <= sim->now_us ) {
+        return;
+    }
+
+    dt = (until_us - sim->now_us) * 1e-6;
+    sim->now_us = until_us;
+
+    for (i = 0; i < MPG_BUS_MAX_NODES; i++) {
+        node = &sim->nodes[i];
+
+        if ( !node->present ) {
+            continue;
+        }
+
+        if ( node->axis != 0 ) {
+            node->wheel_position += node->wheel_rate * dt;
+            node->count = (int32_t) floor(node->wheel_position);
+        }
+
+        if ( sim->now_us >= node->next_change_us && node->next_change_us > 0.0 ) {
+            change_operator(sim, node);
+        }
+    }
+}
+
+
+static void queue_response(mpg_bus_sim_t* sim, const char* frame, int length) {
+    double t;
+    int i;
+
+    t = sim->now_us + sim->turnaround_us;
+
+    if ( t < sim->bus_busy_until_us ) {
+        sim->n_collisions++;
+    }
+
+    for (i = 0; i < length && sim->queue_count < MPG_BUS_SIM_QUEUE_SIZE; i++) {
+        t += sim->char_time_us;
+        sim->queue[(sim->queue_head + sim->queue_count) % MPG_BUS_SIM_QUEUE_SIZE] = (uint8_t) frame[i];
+        sim->queue_time_us[(sim->queue_head + sim->queue_count) % MPG_BUS_SIM_QUEUE_SIZE] = t;
+        sim->queue_count++;
+    }
+
+    sim->bus_busy_until_us = t;
+}
+
+
+/**
+ * Delivers a character on bus to every node, as the firmware's receive ISR would see it.
+ */
+static void node_receive(mpg_bus_sim_t* sim, int address, mpg_bus_sim_node_t* node, char c) {
+    static const char HEX[] = "0123456789ABCDEF";
+
+    char frame[MPG_BUS_RESPONSE_SIZE + 1];
+    int32_t delta;
+
+    if ( c == '@' ) {
+        node->rx_phase = 1;
+        return;
+    }
+
+    if ( node->rx_phase == 1 ) {
+        node->rx_phase = (c == HEX[address]) ? 2 : 0;
+        return;
+    }
+
+    if ( node->rx_phase != 2 ) {
+        return;
+    }
+
+    node->rx_phase = 0;
+
+    if ( c == 'S' ) {
+        delta = node->count - node->reported;
+        node->reported = node->count;
+
+        snprintf(frame, sizeof(frame), "@%c[S%04X%02X]\r\n", HEX[address], (unsigned int) (uint16_t) delta,
+                 (unsigned int) ((node->axis | (node->step << 3)) & 0xFF));
+        queue_response(sim, frame, MPG_BUS_RESPONSE_SIZE);
+    }
+}
+
+
+static int sim_write(void* ctx, const void* data, size_t length) {
+    mpg_bus_sim_t* sim = ctx;
+    const char* chars = data;
+    size_t i;
+    int n;
+
+    for (i = 0; i < length; i++) {
+        // master may not start until bus is free
+        advance(sim, fmax(sim->now_us, sim->bus_busy_until_us) + sim->char_time_us);
+        sim->bus_busy_until_us = sim->now_us;
+
+        for (n = 0; n < MPG_BUS_MAX_NODES; n++) {
+            if ( sim->nodes[n].present ) {
+                node_receive(sim, n, &sim->nodes[n], chars[i]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+static int sim_read(void* ctx, void* data, size_t length, uint32_t timeout_us) {
+    mpg_bus_sim_t* sim = ctx;
+    uint8_t* bytes = data;
+    double deadline;
+    size_t count = 0;
+
+    deadline = sim->now_us + timeout_us;
+
+    while ( count < length && sim->queue_count > 0 && sim->queue_time_us[sim->queue_head] <= deadline ) {
+        advance(sim, sim->queue_time_us[sim->queue_head]);
+        bytes[count++] = sim->queue[sim->queue_head];
+        sim->queue_head = (sim->queue_head + 1) % MPG_BUS_SIM_QUEUE_SIZE;
+        sim->queue_count--;
+    }
+
+    if ( count < length ) {
+        advance(sim, deadline);
+    }
+
+    return (int) count;
+}
+
+
+static void sim_flush(void* ctx) {
+    mpg_bus_sim_t* sim = ctx;
+
+    sim->queue_count = 0;
+}
+
+
+static uint64_t sim_now_us(void* ctx) {
+    mpg_bus_sim_t* sim = ctx;
+
+    return (uint64_t) sim->now_us;
+}
+
+
+void mpg_bus_sim_init(mpg_bus_sim_t* sim, unsigned int baud, double turnaround_us, uint32_t seed) {
+    memset(sim, 0, sizeof(*sim));
+    sim->char_time_us = 10.0 * 1e6 / (double) baud;
+    sim->turnaround_us = turnaround_us;
+    sim->lcg = seed;
+}
+
+
+void mpg_bus_sim_add_node(mpg_bus_sim_t* sim, uint8_t address) {
+    mpg_bus_sim_node_t* node = &sim->nodes[address & 0xF];
+
+    memset(node, 0, sizeof(*node));
+    node->present = true;
+    change_operator(sim, node);
+}
+
+
+void mpg_bus_sim_io(mpg_bus_sim_t* sim, mpg_bus_io_t* io) {
+    io->write = sim_write;
+    io->read = sim_read;
+    io->flush = sim_flush;
+    io->now_us = sim_now_us;
+    io->ctx = sim;
+}
+
+
+void mpg_bus_sim_stop(mpg_bus_sim_t* sim) {
+    int i;
+
+    for (i = 0; i < MPG_BUS_MAX_NODES; i++) {
+        sim->nodes[i].wheel_rate = 0.0;
+        sim->nodes[i].next_change_us = 0.0;
+    }
+}
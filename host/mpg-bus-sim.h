@@ -0,0 +1,106 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Simulated RS-485 multi-drop bus, populated with models of multi-drop MPG-Nano nodes. Runs on a virtual clock,
+ * so bus timing (character times, node turnaround) is reproduced exactly without waiting in real time.
+ */
+#ifndef _MPG_BUS_SIM_H_
+#define _MPG_BUS_SIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mpg-bus.h"
+
+
+// size of queue holding characters in flight to master
+#define MPG_BUS_SIM_QUEUE_SIZE      64
+
+
+/**
+ * Simulated node.
+ */
+typedef struct {
+    bool present;                   // false if nothing answers at this address
+    uint8_t rx_phase;               // 0: waiting for '@', 1: waiting for address, 2: addressed
+    uint8_t axis;
+    uint8_t step;
+    double wheel_rate;              // wheel speed while axis is selected, detents per second
+    double wheel_position;          // wheel position, fractional detents
+    int32_t count;                  // detents turned since start of simulation
+    int32_t reported;               // detents reported to master
+    double next_change_us;          // time at which operator next changes axis/speed
+} mpg_bus_sim_node_t;
+
+
+/**
+ * Simulated bus.
+ */
+typedef struct {
+    mpg_bus_sim_node_t nodes[MPG_BUS_MAX_NODES];
+    double now_us;                  // virtual clock
+    double char_time_us;            // time to send one character
+    double turnaround_us;           // time from end of request to start of response
+    uint8_t queue[MPG_BUS_SIM_QUEUE_SIZE];
+    double queue_time_us[MPG_BUS_SIM_QUEUE_SIZE];
+    int queue_head;
+    int queue_count;
+    double bus_busy_until_us;       // end of last character driven onto bus
+    uint32_t n_collisions;          // responses that overlapped another transmission
+    uint32_t lcg;
+} mpg_bus_sim_t;
+
+
+/**
+ * Initialises simulated bus. No nodes are present until added.
+ *
+ * @param baud          Bus baud rate.
+ * @param turnaround_us Node response latency.
+ * @param seed          Seed for operator behaviour.
+ */
+void mpg_bus_sim_init(mpg_bus_sim_t* sim, unsigned int baud, double turnaround_us, uint32_t seed);
+
+
+/**
+ * Places a node on bus.
+ */
+void mpg_bus_sim_add_node(mpg_bus_sim_t* sim, uint8_t address);
+
+
+/**
+ * Fills in bus access functions for master.
+ */
+void mpg_bus_sim_io(mpg_bus_sim_t* sim, mpg_bus_io_t* io);
+
+
+/**
+ * Stops all wheels, so that counts can be compared once master has caught up.
+ */
+void mpg_bus_sim_stop(mpg_bus_sim_t* sim);
+
+#endif // _MPG_BUS_SIM_H_
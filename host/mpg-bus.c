@@ -0,0 +1,167 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <termios.h>
+
+#include "mpg-bus.h"
+
+
+void mpg_bus_init(mpg_bus_t* bus, const mpg_bus_io_t* io, const uint8_t* addresses, int n_nodes,
+                  unsigned int baud, uint32_t turnaround_us) {
+    int i;
+
+    memset(bus, 0, sizeof(*bus));
+    bus->io = *io;
+    bus->n_nodes = (n_nodes < MPG_BUS_MAX_NODES) ? n_nodes : MPG_BUS_MAX_NODES;
+    bus->idle_interval = 8;
+    bus->max_backoff = 64;
+
+    // response takes 10 bit times per character
+    bus->reply_timeout_us = (uint32_t) ((MPG_BUS_RESPONSE_SIZE * 10ull * 1000000ull + baud - 1) / baud) +
+                            turnaround_us;
+
+    for (i = 0; i < bus->n_nodes; i++) {
+        bus->nodes[i].address = addresses[i] & 0xF;
+        bus->nodes[i].online = true;
+        bus->nodes[i].backoff = 1;
+    }
+}
+
+
+bool mpg_bus_poll(mpg_bus_t* bus, mpg_bus_node_t* node) {
+    static const char HEX[] = "0123456789ABCDEF";
+
+    char request[MPG_BUS_REQUEST_SIZE] = { '@', HEX[node->address], 'S' };
+    char response[MPG_BUS_RESPONSE_SIZE + 1];
+    mpg_host_status_t status;
+
+    node->n_polls++;
+
+    if ( bus->io.write(bus->io.ctx, request, sizeof(request)) != 0 ) {
+        return false;
+    }
+
+    // a short or corrupt response means bus may hold stray characters, so discard them before next request
+    if ( bus->io.read(bus->io.ctx, response, MPG_BUS_RESPONSE_SIZE, bus->reply_timeout_us) != MPG_BUS_RESPONSE_SIZE ||
+            response[0] != '@' || response[1] != request[1] || response[11] != '\r' || response[12] != '\n' ) {
+        bus->io.flush(bus->io.ctx);
+        return false;
+    }
+
+    response[11] = '\0';
+
+    if ( !mpg_host_parse_status(response + 2, &status) ) {
+        bus->io.flush(bus->io.ctx);
+        return false;
+    }
+
+    node->status = status;
+    node->count += status.delta;
+    node->n_replies++;
+
+    return true;
+}
+
+
+int mpg_bus_cycle(mpg_bus_t* bus) {
+    mpg_bus_node_t* node;
+    int n_polled = 0;
+    int i;
+
+    for (i = 0; i < bus->n_nodes; i++) {
+        node = &bus->nodes[i];
+
+        if ( node->skip > 0 ) {
+            node->skip--;
+            continue;
+        }
+
+        n_polled++;
+
+        if ( !mpg_bus_poll(bus, node) ) {
+            // back off absent nodes so they cost little bus time, while still being found when plugged in
+            node->online = false;
+            node->skip = node->backoff - 1;
+
+            if ( node->backoff < bus->max_backoff ) {
+                node->backoff *= 2;
+            }
+
+            continue;
+        }
+
+        node->online = true;
+        node->backoff = 1;
+
+        // nodes with no axis selected and no wheel motion only need checking now and then
+        if ( node->status.axis == 0 && node->status.delta == 0 ) {
+            if ( node->idle_polls < MPG_BUS_IDLE_POLLS ) {
+                node->idle_polls++;
+            }
+        } else {
+            node->idle_polls = 0;
+        }
+
+        node->skip = (node->idle_polls >= MPG_BUS_IDLE_POLLS) ? bus->idle_interval - 1 : 0;
+    }
+
+    bus->n_cycles++;
+
+    return n_polled;
+}
+
+
+static int tty_write(void* ctx, const void* data, size_t length) {
+    return mpg_host_tty_write(*(int*) ctx, data, length);
+}
+
+
+static int tty_read(void* ctx, void* data, size_t length, uint32_t timeout_us) {
+    return mpg_host_tty_read(*(int*) ctx, data, length, (int) ((timeout_us + 999) / 1000));
+}
+
+
+static void tty_flush(void* ctx) {
+    tcflush(*(int*) ctx, TCIOFLUSH);
+}
+
+
+static uint64_t tty_now_us(void* ctx) {
+    (void) ctx;
+
+    return mpg_host_now_us();
+}
+
+
+void mpg_bus_io_tty(mpg_bus_io_t* io, int* fd) {
+    io->write = tty_write;
+    io->read = tty_read;
+    io->flush = tty_flush;
+    io->now_us = tty_now_us;
+    io->ctx = fd;
+}
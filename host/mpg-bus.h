@@ -0,0 +1,138 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * RS-485 multi-drop bus master. Polls several pendants sharing one half-duplex bus, spending bus time on pendants
+ * that are in use rather than on idle or absent ones.
+ */
+#ifndef _MPG_BUS_H_
+#define _MPG_BUS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mpg-host.h"
+
+
+// maximum number of nodes on a bus (node addresses are a single hex digit)
+#define MPG_BUS_MAX_NODES           16
+
+// length of status request ("@aS") and response ("@a[Sxxxxxx]\r\n")
+#define MPG_BUS_REQUEST_SIZE        3
+#define MPG_BUS_RESPONSE_SIZE       13
+
+// number of motionless polls, with no axis selected, after which a node counts as idle
+#define MPG_BUS_IDLE_POLLS          8
+
+
+/**
+ * Bus access functions, so that the master can drive a real serial port or a simulated bus.
+ */
+typedef struct {
+    // writes bytes to bus, returns 0 on success
+    int (*write)(void* ctx, const void* data, size_t length);
+
+    // reads up to length bytes, waiting no longer than timeout_us, returns number of bytes read
+    int (*read)(void* ctx, void* data, size_t length, uint32_t timeout_us);
+
+    // discards unread input
+    void (*flush)(void* ctx);
+
+    // returns current time, in microseconds
+    uint64_t (*now_us)(void* ctx);
+
+    void* ctx;
+} mpg_bus_io_t;
+
+
+/**
+ * State of one node, as seen by master.
+ */
+typedef struct {
+    uint8_t address;
+    bool online;
+    mpg_host_status_t status;       // most recent status
+    int32_t count;                  // encoder count accumulated from all status responses
+    uint32_t n_polls;
+    uint32_t n_replies;
+    uint8_t idle_polls;             // consecutive polls with no motion and no axis selected
+    uint16_t backoff;               // cycles between polls while offline
+    uint16_t skip;                  // cycles left before next poll
+} mpg_bus_node_t;
+
+
+/**
+ * Bus master state.
+ */
+typedef struct {
+    mpg_bus_io_t io;
+    mpg_bus_node_t nodes[MPG_BUS_MAX_NODES];
+    int n_nodes;
+    uint32_t reply_timeout_us;      // time allowed for a complete response after request is sent
+    uint16_t idle_interval;         // idle nodes are polled once every idle_interval cycles
+    uint16_t max_backoff;           // absent nodes are polled at least once every max_backoff cycles
+    uint64_t n_cycles;
+} mpg_bus_t;
+
+
+/**
+ * Initialises bus master.
+ *
+ * @param addresses     Addresses of nodes expected on bus.
+ * @param baud          Bus baud rate, used to size response timeout.
+ * @param turnaround_us Allowance for node response latency and adapter latency (e.g. USB latency timer).
+ */
+void mpg_bus_init(mpg_bus_t* bus, const mpg_bus_io_t* io, const uint8_t* addresses, int n_nodes,
+                  unsigned int baud, uint32_t turnaround_us);
+
+
+/**
+ * Polls one node for its status.
+ *
+ * @return  True if node responded with a valid status.
+ */
+bool mpg_bus_poll(mpg_bus_t* bus, mpg_bus_node_t* node);
+
+
+/**
+ * Runs one polling cycle: nodes in use are polled every cycle, idle nodes every idle_interval cycles and absent
+ * nodes with exponential back-off.
+ *
+ * @return  Number of nodes polled.
+ */
+int mpg_bus_cycle(mpg_bus_t* bus);
+
+
+/**
+ * Fills in bus access functions for a serial port opened with mpg_host_tty_open().
+ *
+ * @param fd            Pointer to file descriptor (must remain valid while bus is in use).
+ */
+void mpg_bus_io_tty(mpg_bus_io_t* io, int* fd);
+
+#endif // _MPG_BUS_H_
@@ -0,0 +1,342 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Benchmarks quadrature decoder variants against the firmware's own decoder (built natively against the register
+ * stand-ins in native/).
+ *
+ * Usage: mpg-decode-bench [-n edges] [-s seed]
+ *
+ * A pseudo-random wheel input stream (spins in either direction at varying lengths, pauses, contact bounce, rocking
+ * part way towards a neighbouring detent and the odd skipped state) is fed to each decoder in turn. Variants that
+ * implement the firmware's counting rule must agree with it exactly; the half-detent variant (counting on arrival at
+ * a detent once half a detent has been passed) is included for comparison and reports how far it strays.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <avr/io.h>
+
+#include "app-encoder.h"
+#include "app-io.h"
+#include "mpg-host.h"
+
+
+// number of states in input stream (replayed until edge count is reached)
+#define BENCH_STREAM_SIZE       (1UL << 20)
+
+// edges per decoder by default
+#define BENCH_DEFAULT_EDGES     200000000UL
+
+// edges between collections of firmware's 16-bit delta counter
+#define BENCH_COLLECT_INTERVAL  4096
+
+
+typedef struct {
+    uint8_t next;
+    int8_t delta;
+} table_entry_t;
+
+
+// direction of each quadrature transition, indexed by (previous state << 2) | state (as in app-encoder.c)
+static const int8_t DIRECTION[16] = {
+         0,  1, -1,  0,
+        -1,  0,  0,  1,
+         1,  0,  0, -1,
+         0, -1,  1,  0
+};
+
+static uint8_t m_states[BENCH_STREAM_SIZE];
+static uint8_t m_pins[BENCH_STREAM_SIZE];
+static table_entry_t m_table[7 * 4 * 4];
+static uint64_t m_seed = 0x2545F4914F6CDD1DULL;
+
+
+static uint32_t random_u32(void) {
+    // xorshift64*
+    m_seed ^= m_seed >> 12;
+    m_seed ^= m_seed << 25;
+    m_seed ^= m_seed >> 27;
+
+    return (uint32_t) ((m_seed * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+
+/**
+ * Fills input stream with wheel movement.
+ */
+static void generate_stream(unsigned long* n_bounces, unsigned long* n_skips) {
+    static const uint8_t FORWARD[4] = { 0x1, 0x3, 0x2, 0x0 };
+
+    unsigned long i = 0;
+    uint32_t length;
+    uint32_t r;
+    int position = 0;
+    int dir;
+
+    *n_bounces = 0;
+    *n_skips = 0;
+
+    while ( i < BENCH_STREAM_SIZE ) {
+        r = random_u32();
+        dir = (r & 1) ? 1 : -1;
+
+        switch((r >> 1) % 8) {
+        case 0:
+            // pause
+            length = 1 + (r >> 8) % 64;
+
+            while ( length-- && i < BENCH_STREAM_SIZE ) {
+                m_states[i++] = FORWARD[position & 3];
+            }
+            break;
+
+        case 1:
+            // rock up to three quarters of a detent and back
+            length = 1 + (r >> 8) % 3;
+
+            for (uint32_t j = 0; j < 2 * length && i < BENCH_STREAM_SIZE; j++) {
+                position += (j < length) ? dir : -dir;
+                m_states[i++] = FORWARD[position & 3];
+            }
+            break;
+
+        case 2:
+            // skipped state (both inputs change at once)
+            position += 2 * dir;
+            m_states[i++] = FORWARD[position & 3];
+            (*n_skips)++;
+            break;
+
+        default:
+            // spin, with occasional contact bounce
+            length = 4 * (1 + (r >> 8) % 100);
+
+            while ( length-- && i < BENCH_STREAM_SIZE ) {
+                position += dir;
+                m_states[i++] = FORWARD[position & 3];
+
+                if ( random_u32() % 64 == 0 && i + 1 < BENCH_STREAM_SIZE ) {
+                    m_states[i++] = FORWARD[(position - dir) & 3];
+                    m_states[i++] = FORWARD[position & 3];
+                    (*n_bounces)++;
+                }
+            }
+            break;
+        }
+    }
+
+    // same stream as seen on PINC by firmware
+    for (i = 0; i < BENCH_STREAM_SIZE; i++) {
+        m_pins[i] = (uint8_t) (((m_states[i] & 1) << APP_IO_C_ENC_AP) | (((m_states[i] >> 1) & 1) << APP_IO_C_ENC_BP));
+    }
+}
+
+
+/**
+ * Builds combined transition table for firmware's counting rule: state is (offset from last detent + 3) * 4 +
+ * previous input state, so that each edge costs one lookup.
+ */
+static void build_table(void) {
+    int offset;
+    int dir;
+
+    for (int s = 0; s < 7 * 4; s++) {
+        for (int input = 0; input < 4; input++) {
+            dir = DIRECTION[((s & 3) << 2) | input];
+            offset = (s >> 2) - 3 + dir;
+
+            m_table[s * 4 + input].delta = 0;
+
+            if ( offset == 4 || offset == -4 ) {
+                m_table[s * 4 + input].delta = (int8_t) (offset / 4);
+                offset = 0;
+            }
+
+            m_table[s * 4 + input].next = (uint8_t) (((offset + 3) << 2) | input);
+        }
+    }
+}
+
+
+static long run_firmware(unsigned long n_edges) {
+    unsigned long i;
+    long count = 0;
+
+    PINC = m_pins[0];
+    app_encoder_init();
+    app_encoder_reset();
+
+    for (i = 0; i < n_edges; i++) {
+        PINC = m_pins[i % BENCH_STREAM_SIZE];
+        app_encoder_loop();
+
+        if ( i % BENCH_COLLECT_INTERVAL == 0 ) {
+            count += app_encoder_delta();
+        }
+    }
+
+    return count + app_encoder_delta();
+}
+
+
+static long run_inline(unsigned long n_edges) {
+    uint8_t prev = (uint8_t) (m_states[0] << 2);
+    int offset = 0;
+    long count = 0;
+    unsigned long i;
+    uint8_t state;
+
+    for (i = 0; i < n_edges; i++) {
+        state = m_states[i % BENCH_STREAM_SIZE];
+        offset += DIRECTION[prev | state];
+        prev = (uint8_t) (state << 2);
+
+        if ( offset == 4 || offset == -4 ) {
+            count += offset / 4;
+            offset = 0;
+        }
+    }
+
+    return count;
+}
+
+
+static long run_table(unsigned long n_edges) {
+    const table_entry_t* entry;
+    uint8_t s = (uint8_t) ((3 << 2) | m_states[0]);
+    long count = 0;
+    unsigned long i;
+
+    for (i = 0; i < n_edges; i++) {
+        entry = &m_table[s * 4 + m_states[i % BENCH_STREAM_SIZE]];
+        count += entry->delta;
+        s = entry->next;
+    }
+
+    return count;
+}
+
+
+static long run_half_detent(unsigned long n_edges) {
+    uint8_t prev = (uint8_t) (m_states[0] << 2);
+    bool armed = false;
+    uint8_t phase = 0;
+    long count = 0;
+    unsigned long i;
+    uint8_t state;
+    int dir;
+
+    for (i = 0; i < n_edges; i++) {
+        state = m_states[i % BENCH_STREAM_SIZE];
+        dir = DIRECTION[prev | state];
+        prev = (uint8_t) (state << 2);
+        phase = (phase + dir) & 3;
+
+        if ( phase == 0 && armed ) {
+            count += dir;
+            armed = false;
+        } else if ( phase == 2 ) {
+            armed = true;
+        }
+    }
+
+    return count;
+}
+
+
+int main(int argc, char* argv[]) {
+    static const struct {
+        const char* name;
+        long (*run)(unsigned long n_edges);
+        bool exact;
+    } DECODERS[] = {
+        { "firmware",       run_firmware,       true },
+        { "inline",         run_inline,         true },
+        { "table",          run_table,          true },
+        { "half-detent",    run_half_detent,    false }
+    };
+
+    unsigned long n_edges = BENCH_DEFAULT_EDGES;
+    unsigned long n_bounces;
+    unsigned long n_skips;
+    uint64_t start_us;
+    double elapsed;
+    long reference = 0;
+    long count;
+    bool ok = true;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "n:s:")) != -1 ) {
+        switch(opt) {
+        case 'n':
+            n_edges = strtoul(optarg, NULL, 0);
+            break;
+
+        case 's':
+            m_seed = strtoull(optarg, NULL, 0) | 1;
+            break;
+
+        default:
+            fprintf(stderr, "usage: %s [-n edges] [-s seed]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    generate_stream(&n_bounces, &n_skips);
+    build_table();
+
+    printf("stream: %lu states (%lu bounces, %lu skipped states), %lu edges per decoder\n", BENCH_STREAM_SIZE,
+           n_bounces, n_skips, n_edges);
+    printf("%-12s %8s %10s %12s\n", "decoder", "ns/edge", "Medges/s", "count");
+
+    for (size_t d = 0; d < sizeof(DECODERS) / sizeof(DECODERS[0]); d++) {
+        start_us = mpg_host_now_us();
+        count = DECODERS[d].run(n_edges);
+        elapsed = (double) (mpg_host_now_us() - start_us) * 1e-6;
+
+        printf("%-12s %8.2f %10.1f %12ld", DECODERS[d].name, elapsed * 1e9 / (double) n_edges,
+               (double) n_edges / elapsed * 1e-6, count);
+
+        if ( d == 0 ) {
+            reference = count;
+        } else if ( DECODERS[d].exact && count != reference ) {
+            printf("  MISMATCH");
+            ok = false;
+        } else if ( !DECODERS[d].exact ) {
+            printf("  (%+ld detents from firmware)", count - reference);
+        }
+
+        printf("\n");
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
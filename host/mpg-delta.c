@@ -0,0 +1,168 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Builds a delta image for the serial boot loader.
+ *
+ * Usage: mpg-delta [-b base.bin] new.bin out.mpgd
+ *
+ * Pages of the new image that match the base image (or, without a base, that are blank) are omitted, so a typical
+ * release-to-release update only carries a handful of pages.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "boot-loader.h"
+#include "mpg-host.h"
+
+
+/**
+ * Loads a firmware binary into a buffer the size of the application region, padded with 0xFF.
+ */
+static uint8_t* load_image(const char* path, uint16_t* length) {
+    uint8_t* image;
+    uint8_t* data;
+    size_t size;
+
+    data = mpg_host_read_file(path, &size);
+
+    if ( !data ) {
+        perror(path);
+        return NULL;
+    }
+
+    if ( size > BOOT_LOADER_APP_SIZE ) {
+        fprintf(stderr, "%s: image is %zu bytes, application region is %u bytes\n", path, size,
+                BOOT_LOADER_APP_SIZE);
+        free(data);
+        return NULL;
+    }
+
+    image = malloc(BOOT_LOADER_APP_SIZE);
+
+    if ( image ) {
+        memset(image, 0xFF, BOOT_LOADER_APP_SIZE);
+        memcpy(image, data, size);
+        *length = (uint16_t) size;
+    }
+
+    free(data);
+
+    return image;
+}
+
+
+int main(int argc, char* argv[]) {
+    static const uint8_t BLANK[BOOT_LOADER_PAGE_SIZE] = { [0 ... BOOT_LOADER_PAGE_SIZE - 1] = 0xFF };
+
+    mpg_host_delta_t delta;
+    const char* base_path = NULL;
+    uint8_t* base_image = NULL;
+    uint8_t* new_image;
+    const uint8_t* ref;
+    uint16_t n_pages;
+    uint16_t i;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "b:")) != -1 ) {
+        switch(opt) {
+        case 'b':
+            base_path = optarg;
+            break;
+
+        default:
+            goto usage;
+        }
+    }
+
+    if ( argc - optind != 2 ) {
+        goto usage;
+    }
+
+    memset(&delta, 0, sizeof(delta));
+
+    if ( base_path ) {
+        base_image = load_image(base_path, &delta.base_length);
+
+        if ( !base_image ) {
+            return EXIT_FAILURE;
+        }
+
+        delta.base_crc = mpg_host_crc16(0, base_image, delta.base_length);
+    }
+
+    new_image = load_image(argv[optind], &delta.new_length);
+
+    if ( !new_image ) {
+        return EXIT_FAILURE;
+    }
+
+    delta.new_crc = mpg_host_crc16(0, new_image, delta.new_length);
+    delta.indices = malloc(BOOT_LOADER_APP_PAGES);
+    delta.pages = malloc(BOOT_LOADER_APP_SIZE);
+
+    if ( !delta.indices || !delta.pages ) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    // boot loader seeds staging area with base pages followed by blank pages, so only differences need sending
+    n_pages = (uint16_t) ((delta.new_length + BOOT_LOADER_PAGE_SIZE - 1) / BOOT_LOADER_PAGE_SIZE);
+
+    for (i = 0; i < n_pages; i++) {
+        const uint8_t* page = new_image + i * BOOT_LOADER_PAGE_SIZE;
+
+        ref = (i * BOOT_LOADER_PAGE_SIZE < delta.base_length) ? base_image + i * BOOT_LOADER_PAGE_SIZE : BLANK;
+
+        if ( memcmp(page, ref, BOOT_LOADER_PAGE_SIZE) != 0 ) {
+            delta.indices[delta.n_pages] = (uint8_t) i;
+            memcpy(delta.pages + delta.n_pages * BOOT_LOADER_PAGE_SIZE, page, BOOT_LOADER_PAGE_SIZE);
+            delta.n_pages++;
+        }
+    }
+
+    if ( !mpg_host_delta_save(&delta, argv[optind + 1]) ) {
+        perror(argv[optind + 1]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%s: %u of %u pages (base %u bytes, crc %04X; new %u bytes, crc %04X)\n", argv[optind + 1],
+           delta.n_pages, n_pages, delta.base_length, delta.base_crc, delta.new_length, delta.new_crc);
+
+    mpg_host_delta_free(&delta);
+    free(base_image);
+    free(new_image);
+
+    return EXIT_SUCCESS;
+
+usage:
+    fprintf(stderr, "usage: %s [-b base.bin] new.bin out.mpgd\n", argv[0]);
+    return EXIT_FAILURE;
+}
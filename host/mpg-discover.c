@@ -0,0 +1,366 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <glob.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "app-serial.h"
+#include "mpg-discover.h"
+#include "mpg-host.h"
+
+
+// glob pattern matching candidate serial ports
+#define CANDIDATE_PATTERN       "/dev/ttyUSB*"
+
+// USB serial adapters fitted to Nanos (vendor ID in upper half, product ID in lower half)
+static const uint32_t ADAPTER_IDS[] = {
+    0x04036001,                 // FTDI FT232R (genuine Nano)
+    0x1A867523                  // WCH CH340 (Nano clones)
+};
+
+// directories that may hold UUCP-style lock files
+static const char* const LOCK_DIRS[] = {
+    "/run/lock",
+    "/var/lock"
+};
+
+// number of sysfs levels searched above tty device for USB vendor and product IDs
+#define SYSFS_MAX_DEPTH         4
+
+// interval between identify requests to a port that has not answered yet
+#define RETRY_INTERVAL_US       50000
+
+// size of per-port receive buffer
+#define LINE_SIZE               32
+
+
+typedef struct {
+    int fd;
+    char path[MPG_DISCOVER_PATH_SIZE];
+    char line[LINE_SIZE];
+    size_t line_length;
+} probe_t;
+
+
+bool mpg_discover_parse_ident(const char* line, mpg_discover_device_t* device) {
+    uint32_t version;
+    uint32_t caps;
+    uint32_t serial_number;
+
+    if ( strlen(line) != 19 || line[0] != '[' || line[1] != 'I' || line[18] != ']' ) {
+        return false;
+    }
+
+    if ( !mpg_host_parse_hex(line + 2, 4, &version) || !mpg_host_parse_hex(line + 6, 4, &caps) ||
+            !mpg_host_parse_hex(line + 10, 8, &serial_number) ) {
+        return false;
+    }
+
+    device->version = (uint16_t) version;
+    device->caps = (uint16_t) caps;
+    device->serial_number = serial_number;
+
+    return true;
+}
+
+
+/**
+ * Reads a hexadecimal sysfs attribute.
+ *
+ * @return  True on success.
+ */
+static bool read_sysfs_hex(const char* dir, const char* name, uint32_t* value) {
+    char path[PATH_MAX];
+    char text[16];
+    char* end;
+    FILE* file;
+    bool ok;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    file = fopen(path, "r");
+
+    if ( !file ) {
+        return false;
+    }
+
+    ok = fgets(text, sizeof(text), file) != NULL;
+    fclose(file);
+
+    if ( ok ) {
+        *value = (uint32_t) strtoul(text, &end, 16);
+        ok = end != text;
+    }
+
+    return ok;
+}
+
+
+/**
+ * @return  True if port belongs to a USB serial adapter of the kind fitted to Nanos. Other USB serial devices (e.g. a
+ *          motion controller that resets when its port is opened) are never touched.
+ */
+static bool is_nano_adapter(const char* path) {
+    char link[PATH_MAX];
+    char dir[PATH_MAX];
+    uint32_t vendor;
+    uint32_t product;
+    size_t i;
+    char* slash;
+    int depth;
+
+    snprintf(link, sizeof(link), "/sys/class/tty/%s/device", strrchr(path, '/') + 1);
+
+    if ( !realpath(link, dir) ) {
+        return false;
+    }
+
+    // IDs live on the USB device, a level or two above the interface the tty belongs to
+    for (depth = 0; depth < SYSFS_MAX_DEPTH; depth++) {
+        if ( read_sysfs_hex(dir, "idVendor", &vendor) && read_sysfs_hex(dir, "idProduct", &product) ) {
+            for (i = 0; i < sizeof(ADAPTER_IDS) / sizeof(ADAPTER_IDS[0]); i++) {
+                if ( ADAPTER_IDS[i] == ((vendor << 16) | product) ) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        slash = strrchr(dir, '/');
+
+        if ( !slash || slash == dir ) {
+            break;
+        }
+
+        *slash = '\0';
+    }
+
+    return false;
+}
+
+
+/**
+ * @return  True if another program holds a lock file for port (stale locks, whose owner has exited, are ignored).
+ */
+static bool is_lock_file_held(const char* path) {
+    char lock[PATH_MAX];
+    FILE* file;
+    size_t i;
+    long pid;
+
+    for (i = 0; i < sizeof(LOCK_DIRS) / sizeof(LOCK_DIRS[0]); i++) {
+        snprintf(lock, sizeof(lock), "%s/LCK..%s", LOCK_DIRS[i], strrchr(path, '/') + 1);
+        file = fopen(lock, "r");
+
+        if ( !file ) {
+            continue;
+        }
+
+        // lock holder's PID is stored in ASCII
+        if ( fscanf(file, "%ld", &pid) != 1 ) {
+            pid = 0;
+        }
+
+        fclose(file);
+
+        if ( pid <= 0 || kill((pid_t) pid, 0) == 0 || errno != ESRCH ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+ * Opens a candidate port, unless it is in use by another program. Port is held exclusively while it is probed.
+ *
+ * @return  File descriptor, or -1 if port cannot be probed.
+ */
+static int probe_open(const char* path, unsigned int baud) {
+    int fd;
+
+    if ( !is_nano_adapter(path) || is_lock_file_held(path) ) {
+        return -1;
+    }
+
+    // open fails with EBUSY if another program has set TIOCEXCL
+    fd = mpg_host_tty_open(path, baud);
+
+    if ( fd < 0 ) {
+        return -1;
+    }
+
+    // respect advisory locks (e.g. pyserial's exclusive mode), then keep others out until probe is finished
+    if ( flock(fd, LOCK_EX | LOCK_NB) < 0 || ioctl(fd, TIOCEXCL) < 0 ) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/**
+ * Consumes input from a port.
+ *
+ * @return  True if a complete identify response has been received.
+ */
+static bool probe_read(probe_t* probe, mpg_discover_device_t* device) {
+    char buffer[64];
+    ssize_t n;
+    ssize_t i;
+
+    while ( (n = read(probe->fd, buffer, sizeof(buffer))) > 0 ) {
+        for (i = 0; i < n; i++) {
+            if ( buffer[i] == '\n' ) {
+                probe->line[probe->line_length] = '\0';
+                probe->line_length = 0;
+
+                if ( mpg_discover_parse_ident(probe->line, device) ) {
+                    return true;
+                }
+            } else if ( buffer[i] != '\r' && probe->line_length + 1 < LINE_SIZE ) {
+                probe->line[probe->line_length++] = buffer[i];
+            }
+        }
+    }
+
+    return false;
+}
+
+
+int mpg_discover(mpg_discover_device_t* devices, int max_devices, unsigned int baud, int timeout_ms) {
+    struct pollfd* pfds = NULL;
+    probe_t* probes = NULL;
+    probe_t* resized;
+    uint64_t next_retry;
+    uint64_t deadline;
+    uint64_t now;
+    size_t n_probes = 0;
+    size_t n_open = 0;
+    size_t i;
+    int n_found = 0;
+    glob_t paths;
+    int fd;
+
+    // open all candidate ports that are free
+    if ( glob(CANDIDATE_PATTERN, 0, NULL, &paths) == 0 ) {
+        resized = realloc(probes, paths.gl_pathc * sizeof(probe_t));
+
+        if ( resized ) {
+            probes = resized;
+
+            for (i = 0; i < paths.gl_pathc; i++) {
+                fd = probe_open(paths.gl_pathv[i], baud);
+
+                if ( fd >= 0 ) {
+                    probes[n_probes].fd = fd;
+                    probes[n_probes].line_length = 0;
+                    snprintf(probes[n_probes].path, MPG_DISCOVER_PATH_SIZE, "%s", paths.gl_pathv[i]);
+                    n_probes++;
+                }
+            }
+        }
+
+        globfree(&paths);
+    }
+
+    pfds = calloc(n_probes + 1, sizeof(struct pollfd));
+
+    if ( !pfds ) {
+        goto done;
+    }
+
+    n_open = n_probes;
+    deadline = mpg_host_now_us() + ((uint64_t) timeout_ms) * 1000u;
+    next_retry = 0;
+
+    // ports are probed together, so total time is set by the slowest responder rather than the number of ports
+    while ( n_open > 0 && n_found < max_devices && (now = mpg_host_now_us()) < deadline ) {
+        if ( now >= next_retry ) {
+            for (i = 0; i < n_probes; i++) {
+                if ( probes[i].fd >= 0 ) {
+                    if ( write(probes[i].fd, "I", 1) < 0 ) {
+                        // ignore, port may not be ready yet
+                    }
+                }
+            }
+
+            next_retry = now + RETRY_INTERVAL_US;
+        }
+
+        for (i = 0; i < n_probes; i++) {
+            pfds[i].fd = probes[i].fd;
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+
+        poll(pfds, n_probes, (int) ((((next_retry < deadline) ? next_retry : deadline) - now + 999) / 1000));
+
+        // several devices may answer in one wake-up, so stop reading once devices array is full
+        for (i = 0; i < n_probes && n_found < max_devices; i++) {
+            if ( probes[i].fd < 0 || !(pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) ) {
+                continue;
+            }
+
+            if ( probe_read(&probes[i], &devices[n_found]) ) {
+                memcpy(devices[n_found].path, probes[i].path, MPG_DISCOVER_PATH_SIZE);
+                n_found++;
+            } else if ( !(pfds[i].revents & (POLLERR | POLLHUP)) ) {
+                continue;
+            }
+
+            close(probes[i].fd);
+            probes[i].fd = -1;
+            n_open--;
+        }
+    }
+
+done:
+    for (i = 0; i < n_probes; i++) {
+        if ( probes[i].fd >= 0 ) {
+            close(probes[i].fd);
+        }
+    }
+
+    free(probes);
+    free(pfds);
+
+    return n_found;
+}
@@ -0,0 +1,83 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * MPG-Nano device discovery. Probes every candidate serial port at once with the identify command, so connecting
+ * takes one round-trip rather than a manual port selection.
+ */
+#ifndef _MPG_DISCOVER_H_
+#define _MPG_DISCOVER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "boot-loader.h"
+#include "mpg-host.h"
+
+
+// default time allowed for discovery: a Nano reset by DTR on port open only starts its application once the boot
+// loader's listen window has passed, and is then allowed a few identify retries
+#define MPG_DISCOVER_TIMEOUT_MS     (MPG_HOST_RESET_DELAY_MS + BOOT_LOADER_LISTEN_MS + 150)
+
+// maximum length of device path
+#define MPG_DISCOVER_PATH_SIZE      64
+
+
+/**
+ * Identity of a discovered device, as reported by the identify command.
+ */
+typedef struct {
+    char path[MPG_DISCOVER_PATH_SIZE];
+    uint16_t version;
+    uint16_t caps;
+    uint32_t serial_number;
+} mpg_discover_device_t;
+
+
+/**
+ * Parses an identify response line (without CR-LF).
+ *
+ * @return  True if line is a valid identify response.
+ */
+bool mpg_discover_parse_ident(const char* line, mpg_discover_device_t* device);
+
+
+/**
+ * Probes all candidate serial ports concurrently. Candidates are /dev/ttyUSB* ports whose USB vendor and product IDs
+ * match an adapter fitted to Nanos (FT232R or CH340). Ports with a live lock file, an advisory lock or exclusive mode
+ * set by another program are skipped.
+ *
+ * @param devices       Array to receive discovered devices.
+ * @param max_devices   Size of devices array.
+ * @param baud          Baud rate the firmware was built for.
+ * @param timeout_ms    Time to wait for devices to answer.
+ *
+ * @return  Number of devices discovered.
+ */
+int mpg_discover(mpg_discover_device_t* devices, int max_devices, unsigned int baud, int timeout_ms);
+
+#endif // _MPG_DISCOVER_H_
@@ -0,0 +1,274 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Uploads a delta image to MPG-Nano over its USB serial link.
+ *
+ * Usage: mpg-flash [-b baud] -p /dev/ttyUSB0 image.mpgd
+ *        mpg-flash [-b baud] -a image.mpgd
+ *
+ * With -a, the port is found by auto-discovery (exactly one device must be attached). -b gives the baud rate the
+ * running firmware was built for (the boot loader itself always talks at BOOT_LOADER_BAUD).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app-serial.h"
+#include "boot-loader.h"
+#include "mpg-discover.h"
+#include "mpg-host.h"
+
+
+// time allowed for boot loader to seed or commit the whole application region
+#define LONG_TIMEOUT_MS         3000
+
+// time allowed for any other boot loader response
+#define SHORT_TIMEOUT_MS        200
+
+
+static bool expect_ack(int fd, int timeout_ms) {
+    uint8_t c;
+
+    return mpg_host_tty_read(fd, &c, 1, timeout_ms) == 1 && c == BOOT_LOADER_ACK;
+}
+
+
+static bool send_cmd16(int fd, char cmd, uint16_t a) {
+    uint8_t buffer[3] = { (uint8_t) cmd, a & 0xFF, a >> 8 };
+
+    return mpg_host_tty_write(fd, buffer, sizeof(buffer)) == 0;
+}
+
+
+/**
+ * Sends wake-up sequence and info command until boot loader answers. The wake-up sequence is needed to catch the
+ * boot loader's listen window after a reset, and is ignored once the boot loader is running.
+ *
+ * @return  True if boot loader answered.
+ */
+static bool query_boot_loader(int fd, int attempts, uint8_t info[4]) {
+    int attempt;
+
+    for (attempt = 0; attempt < attempts; attempt++) {
+        mpg_host_tty_flush(fd);
+        mpg_host_tty_write(fd, BOOT_LOADER_SYNC "I", BOOT_LOADER_SYNC_LENGTH + 1);
+
+        if ( mpg_host_tty_read(fd, info, 4, 20) == 4 && info[0] == BOOT_LOADER_ACK ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+ * Asks application to reset into boot loader, then waits for boot loader to respond at its own baud rate. If the
+ * application does not answer (hung, multi-drop build or different baud rate), resets the Nano and catches the boot
+ * loader in its listen window instead.
+ */
+static bool enter_boot_loader(int fd) {
+    uint8_t info[4];
+    char line[16];
+    int attempt;
+
+    // opening port may have reset the Nano, so allow application time to start
+    for (attempt = 0; attempt < 20; attempt++) {
+        mpg_host_tty_write(fd, "B", 1);
+
+        if ( mpg_host_tty_read_line(fd, line, sizeof(line), 100) >= 0 && strcmp(line, "[B]") == 0 ) {
+            break;
+        }
+    }
+
+    // device may already be sitting in boot loader (e.g. no valid application), so carry on regardless
+    if ( mpg_host_tty_set_baud(fd, BOOT_LOADER_BAUD) < 0 ) {
+        return false;
+    }
+
+    if ( !query_boot_loader(fd, 50, info) ) {
+        if ( attempt < 20 || mpg_host_tty_reset(fd) < 0 ||
+                !query_boot_loader(fd, (MPG_HOST_RESET_DELAY_MS + BOOT_LOADER_LISTEN_MS) / 20, info) ) {
+            fprintf(stderr, "boot loader not responding\n");
+            return false;
+        }
+
+        fprintf(stderr, "application did not answer, entered boot loader by reset\n");
+    }
+
+    if ( info[1] != BOOT_LOADER_VERSION || info[2] != BOOT_LOADER_PAGE_SIZE || info[3] != BOOT_LOADER_APP_PAGES ) {
+        fprintf(stderr, "incompatible boot loader (version %u)\n", info[1]);
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool upload(int fd, const mpg_host_delta_t* delta) {
+    uint8_t record[2 + BOOT_LOADER_PAGE_SIZE + 2];
+    uint8_t crc_bytes[2];
+    uint16_t crc;
+    uint16_t i;
+
+    // a delta is only meaningful against the image it was built from
+    if ( delta->base_length > 0 ) {
+        if ( !send_cmd16(fd, BOOT_LOADER_CMD_VERIFY, delta->base_length) || !expect_ack(fd, SHORT_TIMEOUT_MS) ||
+                mpg_host_tty_read(fd, crc_bytes, 2, SHORT_TIMEOUT_MS) != 2 ) {
+            fprintf(stderr, "verify failed\n");
+            return false;
+        }
+
+        crc = (uint16_t) (crc_bytes[0] | (crc_bytes[1] << 8));
+
+        if ( crc != delta->base_crc ) {
+            fprintf(stderr, "device image (crc %04X) does not match delta base (crc %04X), use a full image\n",
+                    crc, delta->base_crc);
+            return false;
+        }
+    }
+
+    if ( !send_cmd16(fd, BOOT_LOADER_CMD_OPEN, delta->base_length) || !expect_ack(fd, LONG_TIMEOUT_MS) ) {
+        fprintf(stderr, "open failed\n");
+        return false;
+    }
+
+    for (i = 0; i < delta->n_pages; i++) {
+        const uint8_t* page = delta->pages + ((size_t) i) * BOOT_LOADER_PAGE_SIZE;
+
+        crc = mpg_host_crc16(0, page, BOOT_LOADER_PAGE_SIZE);
+        record[0] = BOOT_LOADER_CMD_WRITE;
+        record[1] = delta->indices[i];
+        memcpy(record + 2, page, BOOT_LOADER_PAGE_SIZE);
+        record[2 + BOOT_LOADER_PAGE_SIZE] = crc & 0xFF;
+        record[3 + BOOT_LOADER_PAGE_SIZE] = crc >> 8;
+
+        if ( mpg_host_tty_write(fd, record, sizeof(record)) < 0 || !expect_ack(fd, SHORT_TIMEOUT_MS) ) {
+            fprintf(stderr, "write of page %u failed\n", delta->indices[i]);
+            return false;
+        }
+    }
+
+    // boot loader verifies whole staged image before touching application region
+    if ( !send_cmd16(fd, BOOT_LOADER_CMD_COMMIT, delta->new_length) ||
+            mpg_host_tty_write(fd, (uint8_t[]) { delta->new_crc & 0xFF, delta->new_crc >> 8 }, 2) < 0 ||
+            !expect_ack(fd, LONG_TIMEOUT_MS) ) {
+        fprintf(stderr, "commit failed, previous image retained\n");
+        return false;
+    }
+
+    mpg_host_tty_write(fd, "X", 1);
+
+    return expect_ack(fd, SHORT_TIMEOUT_MS);
+}
+
+
+int main(int argc, char* argv[]) {
+    mpg_discover_device_t devices[2];
+    unsigned int baud = MPG_HOST_APP_BAUD;
+    const char* port = NULL;
+    bool discover = false;
+    mpg_host_delta_t delta;
+    uint64_t start;
+    int n_devices;
+    bool ok;
+    int opt;
+    int fd;
+
+    while ( (opt = getopt(argc, argv, "ab:p:")) != -1 ) {
+        switch(opt) {
+        case 'a':
+            discover = true;
+            break;
+
+        case 'b':
+            baud = (unsigned int) atoi(optarg);
+            break;
+
+        case 'p':
+            port = optarg;
+            break;
+
+        default:
+            goto usage;
+        }
+    }
+
+    // probing opens (and so resets) other devices, so it is only done on request
+    if ( argc - optind != 1 || (port != NULL) == discover ) {
+        goto usage;
+    }
+
+    if ( !mpg_host_delta_load(&delta, argv[optind]) ) {
+        fprintf(stderr, "%s: not a valid delta image\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    if ( discover ) {
+        // room for a second device, so that flashing whichever answers first is never mistaken for the only one
+        n_devices = mpg_discover(devices, 2, baud, MPG_DISCOVER_TIMEOUT_MS);
+
+        if ( n_devices > 1 ) {
+            fprintf(stderr, "more than one device found, use -p to select port\n");
+            return EXIT_FAILURE;
+        }
+
+        if ( n_devices != 1 || !(devices[0].caps & APP_SERIAL_CAP_BOOT) ) {
+            fprintf(stderr, "no device with boot loader found, use -p to select port\n");
+            return EXIT_FAILURE;
+        }
+
+        port = devices[0].path;
+    }
+
+    fd = mpg_host_tty_open(port, baud);
+
+    if ( fd < 0 ) {
+        perror(port);
+        return EXIT_FAILURE;
+    }
+
+    start = mpg_host_now_us();
+    ok = enter_boot_loader(fd) && upload(fd, &delta);
+
+    if ( ok ) {
+        printf("%s: %u pages uploaded in %.2f s\n", port, delta.n_pages,
+               (double) (mpg_host_now_us() - start) / 1e6);
+    }
+
+    close(fd);
+    mpg_host_delta_free(&delta);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+
+usage:
+    fprintf(stderr, "usage: %s [-b baud] -p port image.mpgd\n       %s [-b baud] -a image.mpgd\n", argv[0], argv[0]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,435 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "boot-loader.h"
+#include "mpg-host.h"
+
+
+uint64_t mpg_host_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t) ts.tv_sec) * 1000000u + ((uint64_t) ts.tv_nsec) / 1000u;
+}
+
+
+uint16_t mpg_host_crc16(uint16_t crc, const void* data, size_t length) {
+    const uint8_t* bytes = data;
+    int i;
+
+    while ( length-- ) {
+        crc ^= ((uint16_t) *bytes++) << 8;
+
+        for (i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+
+bool mpg_host_parse_hex(const char* text, int n_digits, uint32_t* value) {
+    int i;
+
+    *value = 0;
+
+    for (i = 0; i < n_digits; i++) {
+        char c = text[i];
+
+        if ( c >= '0' && c <= '9' ) {
+            *value = (*value << 4) | (uint32_t) (c - '0');
+        } else if ( c >= 'A' && c <= 'F' ) {
+            *value = (*value << 4) | (uint32_t) (c - 'A' + 10);
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool mpg_host_parse_status(const char* line, mpg_host_status_t* status) {
+    uint32_t word;
+
+    if ( strlen(line) != 9 || line[0] != '[' || line[1] != 'S' || line[8] != ']' ||
+            !mpg_host_parse_hex(line + 2, 6, &word) ) {
+        return false;
+    }
+
+    status->delta = (int16_t) (uint16_t) (word >> 8);
+    status->axis = word & 0x07;
+    status->step = (word >> 3) & 0x03;
+    status->e_stop = (word & (1 << 5)) != 0;
+
+    return true;
+}
+
+
+unsigned int mpg_host_step_microns(uint8_t step) {
+    static const unsigned int MICRONS[4] = { 1, 10, 100, 1000 };
+
+    return MICRONS[step & 3];
+}
+
+
+static speed_t baud_to_speed(unsigned int baud) {
+    switch(baud) {
+    case 9600:      return B9600;
+    case 19200:     return B19200;
+    case 38400:     return B38400;
+    case 57600:     return B57600;
+    case 115200:    return B115200;
+    case 230400:    return B230400;
+    case 500000:    return B500000;
+    case 1000000:   return B1000000;
+    default:        return B0;
+    }
+}
+
+
+int mpg_host_tty_set_baud(int fd, unsigned int baud) {
+    struct termios tio;
+    speed_t speed;
+
+    speed = baud_to_speed(baud);
+
+    if ( speed == B0 ) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ( tcgetattr(fd, &tio) < 0 ) {
+        return -1;
+    }
+
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+
+    return tcsetattr(fd, TCSADRAIN, &tio);
+}
+
+
+int mpg_host_tty_open(const char* path, unsigned int baud) {
+    struct termios tio;
+    int fd;
+
+    fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+    if ( fd < 0 ) {
+        return -1;
+    }
+
+    if ( tcgetattr(fd, &tio) < 0 ) {
+        goto fail;
+    }
+
+    // raw 8n1, no flow control
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    if ( tcsetattr(fd, TCSANOW, &tio) < 0 || mpg_host_tty_set_baud(fd, baud) < 0 ) {
+        goto fail;
+    }
+
+    return fd;
+
+fail:
+    close(fd);
+    return -1;
+}
+
+
+int mpg_host_tty_reset(int fd) {
+    int lines = TIOCM_DTR | TIOCM_RTS;
+
+    if ( ioctl(fd, TIOCMBIC, &lines) < 0 ) {
+        return -1;
+    }
+
+    usleep(50000);
+
+    return ioctl(fd, TIOCMBIS, &lines);
+}
+
+
+int mpg_host_tty_write(int fd, const void* data, size_t length) {
+    const uint8_t* bytes = data;
+    struct pollfd pfd;
+    ssize_t n;
+
+    while ( length > 0 ) {
+        n = write(fd, bytes, length);
+
+        if ( n < 0 ) {
+            if ( errno != EAGAIN && errno != EINTR ) {
+                return -1;
+            }
+
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, 100);
+            continue;
+        }
+
+        bytes += n;
+        length -= (size_t) n;
+    }
+
+    return 0;
+}
+
+
+int mpg_host_tty_read(int fd, void* data, size_t length, int timeout_ms) {
+    uint8_t* bytes = data;
+    uint64_t deadline;
+    struct pollfd pfd;
+    size_t count = 0;
+    int64_t remaining;
+    ssize_t n;
+
+    deadline = mpg_host_now_us() + ((uint64_t) timeout_ms) * 1000u;
+
+    while ( count < length ) {
+        n = read(fd, bytes + count, length - count);
+
+        if ( n > 0 ) {
+            count += (size_t) n;
+            continue;
+        }
+
+        if ( n < 0 && errno != EAGAIN && errno != EINTR ) {
+            return -1;
+        }
+
+        remaining = (int64_t) (deadline - mpg_host_now_us());
+
+        if ( remaining <= 0 ) {
+            break;
+        }
+
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        poll(&pfd, 1, (int) ((remaining + 999) / 1000));
+    }
+
+    return (int) count;
+}
+
+
+int mpg_host_tty_read_line(int fd, char* line, size_t size, int timeout_ms) {
+    uint64_t deadline;
+    size_t count = 0;
+    int64_t remaining;
+    char c;
+
+    deadline = mpg_host_now_us() + ((uint64_t) timeout_ms) * 1000u;
+
+    for (;;) {
+        remaining = (int64_t) (deadline - mpg_host_now_us());
+
+        if ( remaining <= 0 || mpg_host_tty_read(fd, &c, 1, (int) ((remaining + 999) / 1000)) != 1 ) {
+            return -1;
+        }
+
+        if ( c == '\n' ) {
+            break;
+        }
+
+        if ( c != '\r' && count + 1 < size ) {
+            line[count++] = c;
+        }
+    }
+
+    line[count] = '\0';
+
+    return (int) count;
+}
+
+
+void mpg_host_tty_flush(int fd) {
+    tcflush(fd, TCIFLUSH);
+}
+
+
+uint8_t* mpg_host_read_file(const char* path, size_t* length) {
+    uint8_t* data;
+    FILE* file;
+    long size;
+
+    file = fopen(path, "rb");
+
+    if ( !file ) {
+        return NULL;
+    }
+
+    if ( fseek(file, 0, SEEK_END) < 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) < 0 ) {
+        fclose(file);
+        return NULL;
+    }
+
+    data = malloc(size ? (size_t) size : 1);
+
+    if ( data && fread(data, 1, (size_t) size, file) != (size_t) size ) {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(file);
+    *length = (size_t) size;
+
+    return data;
+}
+
+
+static uint16_t get16(const uint8_t* p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+
+static void put16(uint8_t* p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+
+// delta file header: magic[4], version, reserved, base_length, base_crc, new_length, new_crc, n_pages
+#define DELTA_HEADER_SIZE       16
+
+// delta file record: page index, page data
+#define DELTA_RECORD_SIZE       (1 + BOOT_LOADER_PAGE_SIZE)
+
+
+bool mpg_host_delta_load(mpg_host_delta_t* delta, const char* path) {
+    const uint8_t* record;
+    size_t length;
+    uint8_t* data;
+    uint16_t i;
+
+    memset(delta, 0, sizeof(*delta));
+    data = mpg_host_read_file(path, &length);
+
+    if ( !data ) {
+        return false;
+    }
+
+    if ( length < DELTA_HEADER_SIZE || memcmp(data, MPG_HOST_DELTA_MAGIC, 4) != 0 ||
+            data[4] != MPG_HOST_DELTA_VERSION ) {
+        goto fail;
+    }
+
+    delta->base_length = get16(data + 6);
+    delta->base_crc = get16(data + 8);
+    delta->new_length = get16(data + 10);
+    delta->new_crc = get16(data + 12);
+    delta->n_pages = get16(data + 14);
+
+    if ( length != DELTA_HEADER_SIZE + ((size_t) delta->n_pages) * DELTA_RECORD_SIZE ) {
+        goto fail;
+    }
+
+    delta->indices = malloc(delta->n_pages + 1u);
+    delta->pages = malloc(((size_t) delta->n_pages) * BOOT_LOADER_PAGE_SIZE + 1u);
+
+    if ( !delta->indices || !delta->pages ) {
+        goto fail;
+    }
+
+    for (i = 0; i < delta->n_pages; i++) {
+        record = data + DELTA_HEADER_SIZE + ((size_t) i) * DELTA_RECORD_SIZE;
+        delta->indices[i] = record[0];
+        memcpy(delta->pages + ((size_t) i) * BOOT_LOADER_PAGE_SIZE, record + 1, BOOT_LOADER_PAGE_SIZE);
+    }
+
+    free(data);
+    return true;
+
+fail:
+    free(data);
+    mpg_host_delta_free(delta);
+    return false;
+}
+
+
+bool mpg_host_delta_save(const mpg_host_delta_t* delta, const char* path) {
+    uint8_t header[DELTA_HEADER_SIZE];
+    bool ok = true;
+    FILE* file;
+    uint16_t i;
+
+    memcpy(header, MPG_HOST_DELTA_MAGIC, 4);
+    header[4] = MPG_HOST_DELTA_VERSION;
+    header[5] = 0;
+    put16(header + 6, delta->base_length);
+    put16(header + 8, delta->base_crc);
+    put16(header + 10, delta->new_length);
+    put16(header + 12, delta->new_crc);
+    put16(header + 14, delta->n_pages);
+
+    file = fopen(path, "wb");
+
+    if ( !file ) {
+        return false;
+    }
+
+    ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    for (i = 0; ok && i < delta->n_pages; i++) {
+        ok = fputc(delta->indices[i], file) != EOF &&
+             fwrite(delta->pages + ((size_t) i) * BOOT_LOADER_PAGE_SIZE, 1, BOOT_LOADER_PAGE_SIZE, file) ==
+                BOOT_LOADER_PAGE_SIZE;
+    }
+
+    return (fclose(file) == 0) && ok;
+}
+
+
+void mpg_host_delta_free(mpg_host_delta_t* delta) {
+    free(delta->indices);
+    free(delta->pages);
+    delta->indices = NULL;
+    delta->pages = NULL;
+    delta->n_pages = 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Host-side helpers shared by MPG-Nano tools: serial port access, CRC and delta image files.
+ */
+#ifndef _MPG_HOST_H_
+#define _MPG_HOST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// default application protocol baud rate (firmware's BAUD build setting, tools take -b for other builds)
+#define MPG_HOST_APP_BAUD           38400
+
+// time from reset pulse to boot loader start (oscillator start-up and application CRC check), with margin
+#define MPG_HOST_RESET_DELAY_MS     100
+
+// delta image file magic and format version
+#define MPG_HOST_DELTA_MAGIC        "MPGD"
+#define MPG_HOST_DELTA_VERSION      1
+
+
+/**
+ * Delta image. Holds only those pages of the new image that differ from the base image (or from erased flash if
+ * there is no base image).
+ */
+typedef struct {
+    uint16_t base_length;           // length of base image, 0 if none
+    uint16_t base_crc;              // CRC of base image
+    uint16_t new_length;            // length of new image
+    uint16_t new_crc;               // CRC of new image
+    uint16_t n_pages;               // number of pages in delta
+    uint8_t* indices;               // page index of each page
+    uint8_t* pages;                 // page data, n_pages * BOOT_LOADER_PAGE_SIZE bytes
+} mpg_host_delta_t;
+
+
+/**
+ * Pendant state reported by a status frame.
+ */
+typedef struct {
+    int16_t delta;                  // change in encoder count since previous status frame
+    uint8_t axis;                   // 0: Off, 1: X, 2: Y, 3: Z, 4: 4
+    uint8_t step;                   // 0: x1, 1: x10, 2: x100, 3: x1000
+    bool e_stop;                    // true if e-stop button is pressed
+} mpg_host_status_t;
+
+
+/**
+ * @return  Monotonic time, in microseconds.
+ */
+uint64_t mpg_host_now_us(void);
+
+
+/**
+ * Updates a CRC-16/XMODEM (as computed by avr-libc's _crc_xmodem_update()).
+ */
+uint16_t mpg_host_crc16(uint16_t crc, const void* data, size_t length);
+
+
+/**
+ * Parses upper-case hexadecimal digits.
+ *
+ * @return  True if all digits are valid.
+ */
+bool mpg_host_parse_hex(const char* text, int n_digits, uint32_t* value);
+
+
+/**
+ * Parses a status response line (without CR-LF).
+ *
+ * @return  True if line is a valid status response.
+ */
+bool mpg_host_parse_status(const char* line, mpg_host_status_t* status);
+
+
+/**
+ * @return  Distance moved per encoder count for given step selection, in microns.
+ */
+unsigned int mpg_host_step_microns(uint8_t step);
+
+
+/**
+ * Opens a serial port in raw, non-blocking mode.
+ *
+ * @param path          Device path.
+ * @param baud          Baud rate.
+ *
+ * @return  File descriptor, or -1 on error (errno is set).
+ */
+int mpg_host_tty_open(const char* path, unsigned int baud);
+
+
+/**
+ * Changes the baud rate of an open serial port without closing it (closing would reset the Nano via DTR).
+ *
+ * @return  0 on success, -1 on error.
+ */
+int mpg_host_tty_set_baud(int fd, unsigned int baud);
+
+
+/**
+ * Resets an Arduino-style board by pulsing DTR and RTS (the Nano's auto-reset capacitor turns the falling edge into a
+ * reset pulse). Boot loader listens for its wake-up sequence for BOOT_LOADER_LISTEN_MS after such a reset.
+ *
+ * @return  0 on success, -1 on error (e.g. port has no modem control lines).
+ */
+int mpg_host_tty_reset(int fd);
+
+
+/**
+ * Writes all bytes to serial port.
+ *
+ * @return  0 on success, -1 on error.
+ */
+int mpg_host_tty_write(int fd, const void* data, size_t length);
+
+
+/**
+ * Reads exactly the requested number of bytes from serial port.
+ *
+ * @param timeout_ms    Time to wait for all bytes to arrive.
+ *
+ * @return  Number of bytes read (less than length on timeout), or -1 on error.
+ */
+int mpg_host_tty_read(int fd, void* data, size_t length, int timeout_ms);
+
+
+/**
+ * Reads a CR-LF terminated response line (terminator is stripped).
+ *
+ * @return  Length of line, or -1 on timeout or error.
+ */
+int mpg_host_tty_read_line(int fd, char* line, size_t size, int timeout_ms);
+
+
+/**
+ * Discards any unread input.
+ */
+void mpg_host_tty_flush(int fd);
+
+
+/**
+ * Reads a whole file into a newly allocated buffer.
+ *
+ * @return  Buffer (caller frees), or NULL on error.
+ */
+uint8_t* mpg_host_read_file(const char* path, size_t* length);
+
+
+/**
+ * Loads a delta image file.
+ *
+ * @return  True on success. Release with mpg_host_delta_free().
+ */
+bool mpg_host_delta_load(mpg_host_delta_t* delta, const char* path);
+
+
+/**
+ * Saves a delta image file.
+ *
+ * @return  True on success.
+ */
+bool mpg_host_delta_save(const mpg_host_delta_t* delta, const char* path);
+
+
+/**
+ * Releases memory held by a delta image.
+ */
+void mpg_host_delta_free(mpg_host_delta_t* delta);
+
+#endif // _MPG_HOST_H_
@@ -0,0 +1,340 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Benchmarks the jog trajectory generator against recorded wheel input.
+ *
+ * Usage: mpg-jog-bench [-r recording] [-m preserve|stop] [-f servo_hz] [-v max_vel] [-a max_accel] [-j max_jerk]
+ *
+ * A recording holds one status frame per line, prefixed by its arrival time in microseconds, as written by
+ * mpg-record. Without -r, a built-in synthetic recording is used (fine x1 jogging, a fast x100 spin, single x1000
+ * detents and an x10 reversal, polled at ~100Hz with timing jitter). Distances are in mm.
+ *
+ * Exits with failure if the setpoint exceeds the velocity, acceleration or jerk limit.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mpg-host.h"
+#include "mpg-jog.h"
+
+
+// minimum number of ticks timed when measuring per-tick cost
+#define BENCH_MIN_TICKS     20000000
+
+// time allowed after last frame for axis to come to rest, in seconds
+#define BENCH_SETTLE_TIME   5.0
+
+// relative tolerance on limits, covering rounding in derivatives observed from the velocity setpoint
+#define BENCH_LIMIT_TOLERANCE   1e-9
+
+
+typedef struct {
+    uint64_t time_us;
+    mpg_host_status_t status;
+} frame_t;
+
+
+typedef struct {
+    frame_t* frames;
+    size_t n_frames;
+    size_t capacity;
+} recording_t;
+
+
+static void add_frame(recording_t* rec, uint64_t time_us, int16_t delta, uint8_t step) {
+    if ( rec->n_frames == rec->capacity ) {
+        rec->capacity = rec->capacity ? rec->capacity * 2 : 1024;
+        rec->frames = realloc(rec->frames, rec->capacity * sizeof(frame_t));
+
+        if ( !rec->frames ) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    rec->frames[rec->n_frames].time_us = time_us;
+    rec->frames[rec->n_frames].status.delta = delta;
+    rec->frames[rec->n_frames].status.axis = 1;
+    rec->frames[rec->n_frames].status.step = step;
+    rec->frames[rec->n_frames].status.e_stop = false;
+    rec->n_frames++;
+}
+
+
+static bool load_recording(recording_t* rec, const char* path) {
+    unsigned long long time_us;
+    mpg_host_status_t status;
+    char line[64];
+    char frame[32];
+    FILE* file;
+
+    file = fopen(path, "r");
+
+    if ( !file ) {
+        return false;
+    }
+
+    while ( fgets(line, sizeof(line), file) ) {
+        if ( sscanf(line, "%llu %31s", &time_us, frame) == 2 && mpg_host_parse_status(frame, &status) ) {
+            add_frame(rec, time_us, status.delta, status.step);
+            rec->frames[rec->n_frames - 1].status = status;
+        }
+    }
+
+    fclose(file);
+
+    return rec->n_frames > 0;
+}
+
+
+/**
+ * Builds a synthetic recording: wheel is integrated at 1kHz and sampled by ~100Hz polls with jitter.
+ */
+static void synthesize_recording(recording_t* rec) {
+    // wheel speed profile: duration (s), detents/s at start, detents/s at end, step selection
+    static const struct {
+        double duration;
+        double rate_start;
+        double rate_end;
+        uint8_t step;
+    } SEGMENTS[] = {
+        { 1.0,   5.0,   15.0, 0 },      // fine positioning at x1
+        { 0.5,   0.0,    0.0, 0 },
+        { 0.4,   0.0,  800.0, 2 },      // fast spin at x100, well beyond axis speed
+        { 1.0, 800.0,  800.0, 2 },
+        { 0.2, 800.0,    0.0, 2 },
+        { 0.8,   0.0,    0.0, 2 },
+        { 1.5,   3.3,    3.3, 3 },      // single detents at x1000
+        { 0.5,   0.0,    0.0, 3 },
+        { 0.6, -20.0,  -60.0, 1 },      // reversal at x10
+        { 0.2,   0.0,    0.0, 1 }
+    };
+
+    uint32_t lcg = 12345;
+    uint64_t next_poll_us = 0;
+    uint64_t t_us = 0;
+    double detents = 0.0;
+    double polled = 0.0;
+    size_t i;
+    double t;
+
+    for (i = 0; i < sizeof(SEGMENTS) / sizeof(SEGMENTS[0]); i++) {
+        for (t = 0.0; t < SEGMENTS[i].duration; t += 0.001, t_us += 1000) {
+            detents += 0.001 * (SEGMENTS[i].rate_start +
+                                (SEGMENTS[i].rate_end - SEGMENTS[i].rate_start) * t / SEGMENTS[i].duration);
+
+            // poll every 10ms +/- 3ms, as a host polling over a busy USB serial link would
+            if ( t_us >= next_poll_us ) {
+                add_frame(rec, t_us, (int16_t) (floor(detents) - floor(polled)), SEGMENTS[i].step);
+                polled = detents;
+
+                lcg = lcg * 1103515245u + 12345u;
+                next_poll_us = t_us + 7000 + (lcg >> 16) % 6000;
+            }
+        }
+    }
+}
+
+
+typedef struct {
+    double max_lag;
+    double rms_lag;
+    double final_error;
+    double max_velocity;
+    double max_accel;
+    double max_jerk;
+    double raw_max_velocity;
+    double settle_time;
+    uint64_t n_ticks;
+} result_t;
+
+
+/**
+ * Runs recording through trajectory generator, one servo tick at a time.
+ */
+static void run(const recording_t* rec, const mpg_jog_config_t* config, result_t* result, bool measure) {
+    double prev_velocity = 0.0;
+    double prev_accel = 0.0;
+    double sum_sq_lag = 0.0;
+    double end_time;
+    double wheel = 0.0;
+    double lag;
+    double t;
+    size_t next = 0;
+    mpg_jog_t jog;
+
+    memset(result, 0, sizeof(*result));
+    mpg_jog_init(&jog, config, 0.0);
+    end_time = (double) rec->frames[rec->n_frames - 1].time_us * 1e-6 + BENCH_SETTLE_TIME;
+
+    for (t = 0.0; t < end_time; t += config->servo_period) {
+        double fed = 0.0;
+
+        while ( next < rec->n_frames && (double) rec->frames[next].time_us * 1e-6 <= t ) {
+            double before = jog.target;
+
+            mpg_jog_feed_status(&jog, &rec->frames[next].status, 0.001);
+            fed += jog.target - before;
+            next++;
+        }
+
+        mpg_jog_tick(&jog);
+        result->n_ticks++;
+
+        if ( !measure ) {
+            continue;
+        }
+
+        // lag behind raw wheel position, and what raw position would look like to a servo loop
+        wheel += fed;
+        lag = fabs(wheel - jog.position);
+        sum_sq_lag += lag * lag;
+        result->max_lag = fmax(result->max_lag, lag);
+        result->raw_max_velocity = fmax(result->raw_max_velocity, fabs(fed) / config->servo_period);
+
+        // observed setpoint derivatives, to check limits are respected
+        result->max_velocity = fmax(result->max_velocity, fabs(jog.velocity));
+        result->max_accel = fmax(result->max_accel, fabs(jog.velocity - prev_velocity) / config->servo_period);
+        result->max_jerk = fmax(result->max_jerk,
+                                fabs((jog.velocity - prev_velocity) / config->servo_period - prev_accel) /
+                                config->servo_period);
+        prev_accel = (jog.velocity - prev_velocity) / config->servo_period;
+        prev_velocity = jog.velocity;
+
+        if ( jog.velocity != 0.0 || jog.position != jog.target ) {
+            result->settle_time = t;
+        }
+    }
+
+    result->rms_lag = sqrt(sum_sq_lag / (double) result->n_ticks);
+    result->final_error = wheel - jog.position;
+}
+
+
+int main(int argc, char* argv[]) {
+    mpg_jog_config_t config = {
+        .servo_period = 0.001,
+        .max_velocity = 40.0,
+        .max_accel = 400.0,
+        .max_jerk = 8000.0,
+        .mode = MPG_JOG_MODE_PRESERVE_DISTANCE,
+        .release_time = 0.1
+    };
+
+    recording_t rec = { 0 };
+    const char* rec_path = NULL;
+    result_t result;
+    uint64_t n_ticks = 0;
+    uint64_t start;
+    bool ok;
+    double ns;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "r:m:f:v:a:j:")) != -1 ) {
+        switch(opt) {
+        case 'r':
+            rec_path = optarg;
+            break;
+
+        case 'm':
+            config.mode = (strcmp(optarg, "stop") == 0) ? MPG_JOG_MODE_STOP_ON_RELEASE :
+                          MPG_JOG_MODE_PRESERVE_DISTANCE;
+            break;
+
+        case 'f':
+            config.servo_period = 1.0 / atof(optarg);
+            break;
+
+        case 'v':
+            config.max_velocity = atof(optarg);
+            break;
+
+        case 'a':
+            config.max_accel = atof(optarg);
+            break;
+
+        case 'j':
+            config.max_jerk = atof(optarg);
+            break;
+
+        default:
+            fprintf(stderr, "usage: %s [-r recording] [-m preserve|stop] [-f servo_hz] [-v max_vel] "
+                            "[-a max_accel] [-j max_jerk]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ( rec_path ) {
+        if ( !load_recording(&rec, rec_path) ) {
+            fprintf(stderr, "%s: no status frames\n", rec_path);
+            return EXIT_FAILURE;
+        }
+    } else {
+        synthesize_recording(&rec);
+    }
+
+    // tracking
+    run(&rec, &config, &result, true);
+
+    printf("recording:          %zu frames over %.2f s (%s)\n", rec.n_frames,
+           (double) rec.frames[rec.n_frames - 1].time_us * 1e-6, rec_path ? rec_path : "synthetic");
+    printf("mode:               %s, servo %.0f Hz, v %.1f mm/s, a %.0f mm/s^2, j %.0f mm/s^3\n",
+           (config.mode == MPG_JOG_MODE_STOP_ON_RELEASE) ? "stop on release" : "preserve distance",
+           1.0 / config.servo_period, config.max_velocity, config.max_accel, config.max_jerk);
+    printf("raw feed peak vel:  %.1f mm/s (unfiltered deltas)\n", result.raw_max_velocity);
+    printf("peak vel/acc/jerk:  %.3f mm/s, %.1f mm/s^2, %.0f mm/s^3\n", result.max_velocity, result.max_accel,
+           result.max_jerk);
+    printf("lag max/rms:        %.4f mm, %.4f mm\n", result.max_lag, result.rms_lag);
+    printf("final offset:       %.9f mm (settled at %.3f s)\n", result.final_error, result.settle_time);
+
+    // a motion controller with hard limits faults on any excursion, however small
+    ok = result.max_velocity <= config.max_velocity * (1.0 + BENCH_LIMIT_TOLERANCE) &&
+         result.max_accel <= config.max_accel * (1.0 + BENCH_LIMIT_TOLERANCE) &&
+         result.max_jerk <= config.max_jerk * (1.0 + BENCH_LIMIT_TOLERANCE);
+
+    printf("limits:             %s\n", ok ? "respected" : "EXCEEDED");
+
+    // per-tick cost
+    start = mpg_host_now_us();
+
+    while ( n_ticks < BENCH_MIN_TICKS ) {
+        run(&rec, &config, &result, false);
+        n_ticks += result.n_ticks;
+    }
+
+    ns = (double) (mpg_host_now_us() - start) * 1e3 / (double) n_ticks;
+    printf("tick cost:          %.1f ns (%llu ticks)\n", ns, (unsigned long long) n_ticks);
+
+    free(rec.frames);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
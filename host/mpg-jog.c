@@ -0,0 +1,178 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "mpg-jog.h"
+
+
+static double sign(double x) {
+    return (x > 0.0) ? 1.0 : ((x < 0.0) ? -1.0 : 0.0);
+}
+
+
+static double clamp(double x, double limit) {
+    return (x > limit) ? limit : ((x < -limit) ? -limit : x);
+}
+
+
+/**
+ * @return  Distance needed to stop from speed v (starting with zero acceleration) under accel and jerk limits.
+ */
+static double stop_distance(const mpg_jog_config_t* config, double v) {
+    double a = config->max_accel;
+    double j = config->max_jerk;
+
+    if ( v * j < a * a ) {
+        // acceleration never reaches its limit
+        return v * sqrt(v / j);
+    }
+
+    return 0.5 * v * (v / a + a / j);
+}
+
+
+/**
+ * @return  Highest speed (with zero acceleration) from which the setpoint can stop within distance d.
+ */
+static double stop_speed(const mpg_jog_config_t* config, double d) {
+    double a = config->max_accel;
+    double j = config->max_jerk;
+
+    if ( d * j * j < a * a * a ) {
+        return cbrt(d * d * j);
+    }
+
+    return 0.5 * (sqrt(a * a * a * a / (j * j) + 8.0 * a * d) - a * a / j);
+}
+
+
+/**
+ * @return  Largest acceleration for this tick from which acceleration can be ramped back to zero, one jerk-limited step
+ *          per tick, with velocity gaining no more than room on the way.
+ */
+static double ramp_limit(const mpg_jog_config_t* config, double room) {
+    double dt = config->servo_period;
+    double j = config->max_jerk;
+    double n;
+
+    if ( room <= 0.0 ) {
+        return room / dt;
+    }
+
+    // number of whole jerk steps that fit, ramp then gains (n + 1) * a * dt less j * dt^2 * n * (n + 1) / 2
+    n = floor(0.5 * (sqrt(1.0 + 8.0 * room / (j * dt * dt)) - 1.0));
+
+    return room / ((n + 1.0) * dt) + 0.5 * j * dt * n;
+}
+
+
+void mpg_jog_init(mpg_jog_t* jog, const mpg_jog_config_t* config, double position) {
+    memset(jog, 0, sizeof(*jog));
+    jog->config = *config;
+    jog->target = position;
+    jog->position = position;
+}
+
+
+void mpg_jog_feed(mpg_jog_t* jog, double distance) {
+    if ( distance != 0.0 ) {
+        jog->target += distance;
+        jog->idle_time = 0.0;
+    }
+}
+
+
+void mpg_jog_feed_status(mpg_jog_t* jog, const mpg_host_status_t* status, double unit_per_micron) {
+    // wheel motion is ignored if no axis is selected or e-stop is pressed, as the firmware's host would do
+    if ( status->axis != 0 && !status->e_stop ) {
+        mpg_jog_feed(jog, status->delta * (double) mpg_host_step_microns(status->step) * unit_per_micron);
+    }
+}
+
+
+double mpg_jog_tick(mpg_jog_t* jog) {
+    const mpg_jog_config_t* config = &jog->config;
+    double dt = config->servo_period;
+    double j = config->max_jerk;
+    double v_projected;
+    double v_wanted;
+    double a_wanted;
+    double error;
+    double dv;
+
+    // on release, replace outstanding motion with the shortest stop from current state
+    if ( config->mode == MPG_JOG_MODE_STOP_ON_RELEASE && jog->idle_time < config->release_time &&
+            jog->idle_time + dt >= config->release_time ) {
+        v_projected = jog->velocity + jog->accel * fabs(jog->accel) / (2.0 * j);
+
+        if ( sign(v_projected) * sign(jog->target - jog->position) > 0.0 ) {
+            jog->target = jog->position + sign(v_projected) * stop_distance(config, fabs(v_projected));
+        }
+    }
+
+    jog->idle_time += dt;
+
+    error = jog->target - jog->position;
+
+    // settle exactly on target once remaining motion is small enough that stopping dead stays within jerk and
+    // acceleration limits
+    if ( fabs(error) < 0.25 * j * dt * dt * dt && fabs(jog->velocity) < 0.25 * j * dt * dt &&
+            fabs(jog->accel) < 0.25 * j * dt && fabs(jog->velocity) <= config->max_accel * dt ) {
+        // acceleration is left at whatever stopped the setpoint this tick, so the next tick's jerk limit applies to it
+        jog->accel = -jog->velocity / dt;
+        jog->position = jog->target;
+        jog->velocity = 0.0;
+
+        return jog->position;
+    }
+
+    // velocity setpoint will reach if acceleration is ramped to zero now
+    v_projected = jog->velocity + jog->accel * fabs(jog->accel) / (2.0 * j);
+
+    // fastest velocity toward target from which axis can still stop on it
+    v_wanted = sign(error) * fmin(config->max_velocity, stop_speed(config, fabs(error)));
+
+    // acceleration from which a jerk-limited ramp to zero lands on wanted velocity
+    dv = v_wanted - v_projected;
+    a_wanted = clamp(sign(dv) * sqrt(2.0 * j * fabs(dv)), config->max_accel);
+
+    // apply jerk limit
+    jog->accel += clamp(a_wanted - jog->accel, j * dt);
+
+    // projection above is continuous, so hold velocity limit in discrete time (the limit only ever tightens by one
+    // jerk step per tick, so this never breaks jerk limit)
+    jog->accel = fmin(jog->accel, ramp_limit(config, config->max_velocity - jog->velocity));
+    jog->accel = fmax(jog->accel, -ramp_limit(config, config->max_velocity + jog->velocity));
+
+    // integrate
+    jog->velocity += jog->accel * dt;
+    jog->position += jog->velocity * dt;
+
+    return jog->position;
+}
@@ -0,0 +1,105 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Jerk-limited jog trajectory generator. Turns bursty, quantised pendant wheel motion into a smooth position and
+ * velocity setpoint stream at a motion controller's servo rate.
+ */
+#ifndef _MPG_JOG_H_
+#define _MPG_JOG_H_
+
+#include <stdint.h>
+
+#include "mpg-host.h"
+
+
+/**
+ * Enumeration of behaviours when wheel stops turning.
+ */
+typedef enum {
+    MPG_JOG_MODE_PRESERVE_DISTANCE,     // <-- every detent is travelled, however far behind the axis is
+    MPG_JOG_MODE_STOP_ON_RELEASE        // <-- outstanding motion is dropped and axis brakes as soon as wheel stops
+} mpg_jog_mode_t;
+
+
+/**
+ * Trajectory generator configuration. Units are arbitrary but must be consistent (e.g. mm, mm/s, mm/s^2, mm/s^3).
+ */
+typedef struct {
+    double servo_period;                // time between calls to mpg_jog_tick(), in seconds
+    double max_velocity;
+    double max_accel;
+    double max_jerk;
+    mpg_jog_mode_t mode;
+    double release_time;                // time without wheel motion after which wheel counts as released
+} mpg_jog_config_t;
+
+
+/**
+ * Trajectory generator state.
+ */
+typedef struct {
+    mpg_jog_config_t config;
+    double target;                      // position the wheel has asked for
+    double position;                    // position setpoint
+    double velocity;                    // velocity setpoint
+    double accel;                       // acceleration of setpoint
+    double idle_time;                   // time since wheel last moved
+} mpg_jog_t;
+
+
+/**
+ * Initialises trajectory generator at rest.
+ *
+ * @param position      Initial axis position.
+ */
+void mpg_jog_init(mpg_jog_t* jog, const mpg_jog_config_t* config, double position);
+
+
+/**
+ * Adds wheel motion to target position.
+ */
+void mpg_jog_feed(mpg_jog_t* jog, double distance);
+
+
+/**
+ * Adds wheel motion reported by a status frame.
+ *
+ * @param unit_per_micron   Conversion from the pendant's micron-based step sizes to trajectory units
+ *                          (e.g. 0.001 for mm).
+ */
+void mpg_jog_feed_status(mpg_jog_t* jog, const mpg_host_status_t* status, double unit_per_micron);
+
+
+/**
+ * Advances trajectory by one servo period.
+ *
+ * @return  New position setpoint (velocity setpoint is left in jog->velocity).
+ */
+double mpg_jog_tick(mpg_jog_t* jog);
+
+#endif // _MPG_JOG_H_
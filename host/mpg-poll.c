@@ -0,0 +1,266 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Polls MPG-Nano pendants on an RS-485 multi-drop bus, or on a simulated bus.
+ *
+ * Usage: mpg-poll [-p port] [-b baud] [-t turnaround_us] [-d seconds] [-r] [-s [-m missing]...] address...
+ *
+ *   -s     simulate: nodes are placed at each address on a virtual bus (except those given with -m), operators pick
+ *          pendants up and put them down at random, and the counts seen by the master are checked against the
+ *          wheels at the end of the run
+ *   -r     plain round-robin polling, for comparison with the default schedule
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mpg-bus.h"
+#include "mpg-bus-sim.h"
+#include "mpg-host.h"
+
+
+// default node turnaround allowance for a USB RS-485 adapter (covers USB latency timer)
+#define TTY_TURNAROUND_US       2000
+
+// node turnaround on simulated bus (one firmware main loop iteration plus ISR latency)
+#define SIM_TURNAROUND_US       50
+
+// time allowed after wheels stop for master to collect outstanding counts
+#define SIM_SETTLE_US           500000
+
+
+static int parse_address(const char* text) {
+    char* end;
+    long value;
+
+    value = strtol(text, &end, 16);
+
+    return (*end == '\0' && value >= 0 && value < MPG_BUS_MAX_NODES) ? (int) value : -1;
+}
+
+
+static void print_nodes(const mpg_bus_t* bus) {
+    const mpg_bus_node_t* node;
+    int i;
+
+    for (i = 0; i < bus->n_nodes; i++) {
+        node = &bus->nodes[i];
+
+        printf("node %X: %-7s axis %u step %u count %8d (%u/%u replies)\n", node->address,
+               node->online ? "online" : "offline", node->status.axis, node->status.step, node->count,
+               node->n_replies, node->n_polls);
+    }
+}
+
+
+static int run_sim(mpg_bus_t* bus, mpg_bus_sim_t* sim, const bool* missing, double duration) {
+    uint64_t active_replies = 0;
+    uint64_t n_polls = 0;
+    uint32_t replies[MPG_BUS_MAX_NODES];
+    int mismatches = 0;
+    int i;
+
+    while ( sim->now_us < duration * 1e6 ) {
+        for (i = 0; i < bus->n_nodes; i++) {
+            replies[i] = bus->nodes[i].n_replies;
+        }
+
+        n_polls += (uint64_t) mpg_bus_cycle(bus);
+
+        // useful updates are those from pendants that are in use
+        for (i = 0; i < bus->n_nodes; i++) {
+            if ( bus->nodes[i].n_replies != replies[i] && bus->nodes[i].status.axis != 0 ) {
+                active_replies++;
+            }
+        }
+    }
+
+    printf("%.1f s simulated: %llu cycles, %llu polls, %.0f updates/s from pendants in use, %u collisions\n",
+           duration, (unsigned long long) bus->n_cycles, (unsigned long long) n_polls,
+           (double) active_replies / duration, sim->n_collisions);
+
+    // stop wheels and let master catch up before checking counts
+    mpg_bus_sim_stop(sim);
+
+    while ( sim->now_us < duration * 1e6 + SIM_SETTLE_US ) {
+        mpg_bus_cycle(bus);
+    }
+
+    print_nodes(bus);
+
+    for (i = 0; i < bus->n_nodes; i++) {
+        uint8_t address = bus->nodes[i].address;
+
+        if ( !missing[address] && bus->nodes[i].count != sim->nodes[address].count ) {
+            printf("node %X: master count %d, wheel count %d\n", address, bus->nodes[i].count,
+                   sim->nodes[address].count);
+            mismatches++;
+        }
+
+        if ( missing[address] == bus->nodes[i].online ) {
+            printf("node %X: %s but reported %s\n", address, missing[address] ? "missing" : "present",
+                   bus->nodes[i].online ? "online" : "offline");
+            mismatches++;
+        }
+    }
+
+    printf("%s\n", (mismatches || sim->n_collisions) ? "FAIL" : "PASS");
+
+    return (mismatches || sim->n_collisions) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+static int run_tty(mpg_bus_t* bus, double duration) {
+    uint64_t start;
+    uint64_t next_print;
+
+    start = mpg_host_now_us();
+    next_print = start;
+
+    while ( duration <= 0.0 || mpg_host_now_us() < start + (uint64_t) (duration * 1e6) ) {
+        mpg_bus_cycle(bus);
+
+        if ( mpg_host_now_us() >= next_print ) {
+            print_nodes(bus);
+            printf("\n");
+            next_print += 500000;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char* argv[]) {
+    uint8_t addresses[MPG_BUS_MAX_NODES];
+    bool missing[MPG_BUS_MAX_NODES] = { false };
+    const char* port = "/dev/ttyUSB0";
+    unsigned int baud = 500000;
+    uint32_t turnaround_us = 0;
+    double duration = 10.0;
+    bool round_robin = false;
+    bool simulate = false;
+    int n_addresses = 0;
+    mpg_bus_sim_t sim;
+    mpg_bus_io_t io;
+    mpg_bus_t bus;
+    int address;
+    int opt;
+    int fd;
+    int i;
+
+    while ( (opt = getopt(argc, argv, "p:b:t:d:rsm:")) != -1 ) {
+        switch(opt) {
+        case 'p':
+            port = optarg;
+            break;
+
+        case 'b':
+            baud = (unsigned int) atoi(optarg);
+            break;
+
+        case 't':
+            turnaround_us = (uint32_t) atoi(optarg);
+            break;
+
+        case 'd':
+            duration = atof(optarg);
+            break;
+
+        case 'r':
+            round_robin = true;
+            break;
+
+        case 's':
+            simulate = true;
+            break;
+
+        case 'm':
+            if ( (address = parse_address(optarg)) < 0 ) {
+                goto usage;
+            }
+
+            missing[address] = true;
+            break;
+
+        default:
+            goto usage;
+        }
+    }
+
+    for (i = optind; i < argc && n_addresses < MPG_BUS_MAX_NODES; i++) {
+        if ( (address = parse_address(argv[i])) < 0 ) {
+            goto usage;
+        }
+
+        addresses[n_addresses++] = (uint8_t) address;
+    }
+
+    if ( n_addresses == 0 || baud == 0 ) {
+        goto usage;
+    }
+
+    if ( simulate ) {
+        mpg_bus_sim_init(&sim, baud, SIM_TURNAROUND_US, 1);
+
+        for (i = 0; i < n_addresses; i++) {
+            if ( !missing[addresses[i]] ) {
+                mpg_bus_sim_add_node(&sim, addresses[i]);
+            }
+        }
+
+        mpg_bus_sim_io(&sim, &io);
+        turnaround_us = turnaround_us ? turnaround_us : 2 * SIM_TURNAROUND_US;
+    } else {
+        fd = mpg_host_tty_open(port, baud);
+
+        if ( fd < 0 ) {
+            perror(port);
+            return EXIT_FAILURE;
+        }
+
+        mpg_bus_io_tty(&io, &fd);
+        turnaround_us = turnaround_us ? turnaround_us : TTY_TURNAROUND_US;
+    }
+
+    mpg_bus_init(&bus, &io, addresses, n_addresses, baud, turnaround_us);
+
+    if ( round_robin ) {
+        bus.idle_interval = 1;
+        bus.max_backoff = 1;
+    }
+
+    return simulate ? run_sim(&bus, &sim, missing, duration) : run_tty(&bus, duration);
+
+usage:
+    fprintf(stderr, "usage: %s [-p port] [-b baud] [-t turnaround_us] [-d seconds] [-r] [-s [-m missing]...] "
+                    "address...\n", argv[0]);
+    return EXIT_FAILURE;
+}
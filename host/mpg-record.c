@@ -0,0 +1,121 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Records pendant status frames for replay by mpg-jog-bench.
+ *
+ * Usage: mpg-record [-p port] [-b baud] [-r poll_hz] [-d seconds] > recording.txt
+ *
+ * Each line holds a frame's arrival time in microseconds followed by the frame itself.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mpg-discover.h"
+#include "mpg-host.h"
+
+
+int main(int argc, char* argv[]) {
+    mpg_discover_device_t device;
+    mpg_host_status_t status;
+    unsigned int baud = MPG_HOST_APP_BAUD;
+    const char* port = NULL;
+    double duration = 10.0;
+    double rate = 100.0;
+    uint64_t next_poll;
+    uint64_t start;
+    uint64_t now;
+    char line[32];
+    int opt;
+    int fd;
+
+    while ( (opt = getopt(argc, argv, "p:b:r:d:")) != -1 ) {
+        switch(opt) {
+        case 'p':
+            port = optarg;
+            break;
+
+        case 'b':
+            baud = (unsigned int) atoi(optarg);
+            break;
+
+        case 'r':
+            rate = atof(optarg);
+            break;
+
+        case 'd':
+            duration = atof(optarg);
+            break;
+
+        default:
+            fprintf(stderr, "usage: %s [-p port] [-b baud] [-r poll_hz] [-d seconds]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ( !port ) {
+        if ( mpg_discover(&device, 1, baud, MPG_DISCOVER_TIMEOUT_MS) != 1 ) {
+            fprintf(stderr, "no device found, use -p to select port\n");
+            return EXIT_FAILURE;
+        }
+
+        port = device.path;
+    }
+
+    fd = mpg_host_tty_open(port, baud);
+
+    if ( fd < 0 ) {
+        perror(port);
+        return EXIT_FAILURE;
+    }
+
+    // discard count accumulated before recording starts
+    mpg_host_tty_write(fd, "R", 1);
+    mpg_host_tty_read_line(fd, line, sizeof(line), 500);
+
+    start = mpg_host_now_us();
+    next_poll = start;
+
+    while ( (now = mpg_host_now_us()) < start + (uint64_t) (duration * 1e6) ) {
+        if ( now < next_poll ) {
+            usleep((useconds_t) (next_poll - now));
+        }
+
+        next_poll += (uint64_t) (1e6 / rate);
+        mpg_host_tty_write(fd, "S", 1);
+
+        if ( mpg_host_tty_read_line(fd, line, sizeof(line), 100) >= 0 && mpg_host_parse_status(line, &status) ) {
+            printf("%llu %s\n", (unsigned long long) (mpg_host_now_us() - start), line);
+        }
+    }
+
+    close(fd);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,82 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Lists attached MPG-Nano devices.
+ *
+ * Usage: mpg-scan [-b baud] [-t timeout_ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mpg-discover.h"
+#include "mpg-host.h"
+
+
+// maximum number of devices listed
+#define MAX_DEVICES         32
+
+
+int main(int argc, char* argv[]) {
+    mpg_discover_device_t devices[MAX_DEVICES];
+    unsigned int baud = MPG_HOST_APP_BAUD;
+    int timeout_ms = MPG_DISCOVER_TIMEOUT_MS;
+    uint64_t start;
+    int n_devices;
+    int opt;
+    int i;
+
+    while ( (opt = getopt(argc, argv, "b:t:")) != -1 ) {
+        switch(opt) {
+        case 'b':
+            baud = (unsigned int) atoi(optarg);
+            break;
+
+        case 't':
+            timeout_ms = atoi(optarg);
+            break;
+
+        default:
+            fprintf(stderr, "usage: %s [-b baud] [-t timeout_ms]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    start = mpg_host_now_us();
+    n_devices = mpg_discover(devices, MAX_DEVICES, baud, timeout_ms);
+
+    for (i = 0; i < n_devices; i++) {
+        printf("%s: version %u.%u, capabilities %04X, serial number %08X\n", devices[i].path,
+               devices[i].version >> 8, devices[i].version & 0xFF, devices[i].caps, devices[i].serial_number);
+    }
+
+    printf("%d device(s) found in %.0f ms\n", n_devices, (double) (mpg_host_now_us() - start) / 1e3);
+
+    return (n_devices > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
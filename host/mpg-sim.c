@@ -0,0 +1,413 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Runs MPG-Nano firmware under simavr with USART0 bridged to a pseudo-terminal, so that host tools (mpg-flash etc.)
+ * can be exercised without hardware.
+ *
+ * Usage: mpg-sim [-b mpg-nano-boot.elf] [-w detents_per_s [-d seconds]] mpg-nano.elf
+ *
+ * With -b, the boot loader is loaded alongside the application and execution starts at the boot loader, as it does
+ * on a Nano with BOOTRST programmed. Simulation is throttled to real time so that host-side timeouts behave as they
+ * would against hardware.
+ *
+ * With -w, the switches are set to X axis at x1 and the wheel is turned at the given rate by driving the encoder's
+ * quadrature inputs. For firmware built with STANDALONE=1, each STEP rising edge on D10 is timed against the detent
+ * that caused it, and the step count and wheel-to-step latency are reported after -d seconds.
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+
+#include "boot-loader.h"
+#include "mpg-host.h"
+
+
+// default target, used if firmware does not carry a simavr .mmcu section
+#define SIM_MCU             "atmega328p"
+#define SIM_FREQ            16000000
+
+// number of avr_run() calls between pseudo-terminal polls
+#define SIM_POLL_INTERVAL   256
+
+// pendant and step output pins (must match app-io.h)
+#define SIM_PIN_B_AXIS_Z    0
+#define SIM_PIN_B_AXIS_4    1
+#define SIM_PIN_B_STEP      2
+#define SIM_PIN_C_ENC_AP    0
+#define SIM_PIN_C_ENC_BP    2
+#define SIM_PIN_C_AXIS_X    4
+#define SIM_PIN_C_AXIS_Y    5
+#define SIM_PIN_D_X1        2
+#define SIM_PIN_D_X10       3
+#define SIM_PIN_D_X100      4
+#define SIM_PIN_D_ESTOP     6
+#define SIM_PIN_D_RAPID     7
+
+
+static int m_pty;
+static bool m_xon = true;
+static avr_irq_t* m_uart_input;
+
+// wheel drive and step output measurement
+static avr_irq_t* m_enc_a;
+static avr_irq_t* m_enc_b;
+static avr_cycle_count_t m_wheel_period;
+static uint8_t m_wheel_phase;
+static uint32_t m_detents;
+static avr_cycle_count_t m_detent_cycle;
+static bool m_awaiting_step;
+static uint32_t m_steps;
+static uint32_t m_n_latencies;
+static avr_cycle_count_t m_latency_min = UINT64_MAX;
+static avr_cycle_count_t m_latency_max;
+static avr_cycle_count_t m_latency_total;
+static uint32_t m_step_level;
+
+
+static void uart_output_hook(struct avr_irq_t* irq, uint32_t value, void* param) {
+    uint8_t c = (uint8_t) value;
+
+    (void) irq;
+    (void) param;
+
+    mpg_host_tty_write(m_pty, &c, 1);
+}
+
+
+static void uart_xon_hook(struct avr_irq_t* irq, uint32_t value, void* param) {
+    (void) irq;
+    (void) value;
+    (void) param;
+
+    m_xon = true;
+}
+
+
+static void uart_xoff_hook(struct avr_irq_t* irq, uint32_t value, void* param) {
+    (void) irq;
+    (void) value;
+    (void) param;
+
+    m_xon = false;
+}
+
+
+/**
+ * Feeds pending pseudo-terminal input into simulated USART0 for as long as it will accept it.
+ */
+static void pump_input(void) {
+    uint8_t c;
+
+    while ( m_xon && read(m_pty, &c, 1) == 1 ) {
+        avr_raise_irq(m_uart_input, c);
+    }
+}
+
+
+/**
+ * Advances wheel by one quadrature transition (A leads B, i.e. positive direction). The firmware counts a detent on
+ * the transition back to A = B = 0.
+ */
+static avr_cycle_count_t wheel_timer(struct avr_t* avr, avr_cycle_count_t when, void* param) {
+    static const uint8_t SEQUENCE[4] = { 0x1, 0x3, 0x2, 0x0 };
+
+    uint8_t bits;
+
+    (void) param;
+
+    bits = SEQUENCE[m_wheel_phase];
+    m_wheel_phase = (m_wheel_phase + 1) & 3;
+
+    avr_raise_irq(m_enc_a, bits & 1);
+    avr_raise_irq(m_enc_b, (bits >> 1) & 1);
+
+    if ( bits == 0 ) {
+        m_detents++;
+
+        // time from detent to next rising edge (only meaningful if wheel is slow enough for output to come to rest
+        // between detents)
+        if ( !m_awaiting_step ) {
+            m_detent_cycle = avr->cycle;
+            m_awaiting_step = true;
+        }
+    }
+
+    return when + m_wheel_period;
+}
+
+
+static void step_output_hook(struct avr_irq_t* irq, uint32_t value, void* param) {
+    avr_cycle_count_t latency;
+    avr_t* avr = (avr_t*) param;
+
+    (void) irq;
+
+    value &= 1;
+
+    if ( value && !m_step_level ) {
+        m_steps++;
+
+        if ( m_awaiting_step ) {
+            latency = avr->cycle - m_detent_cycle;
+            m_latency_total += latency;
+            m_n_latencies++;
+            m_awaiting_step = false;
+
+            if ( latency < m_latency_min ) {
+                m_latency_min = latency;
+            }
+
+            if ( latency > m_latency_max ) {
+                m_latency_max = latency;
+            }
+        }
+    }
+
+    m_step_level = value;
+}
+
+
+/**
+ * Sets a switch input (as the pendant wiring would drive it) and leaves it there.
+ */
+static void set_input(avr_t* avr, char port, int pin, uint32_t value) {
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), pin), value);
+}
+
+
+/**
+ * Selects X axis at x1, releases e-stop and starts turning wheel at given rate.
+ */
+static void start_wheel(avr_t* avr, double rate) {
+    set_input(avr, 'C', SIM_PIN_C_AXIS_X, 0);
+    set_input(avr, 'C', SIM_PIN_C_AXIS_Y, 1);
+    set_input(avr, 'B', SIM_PIN_B_AXIS_Z, 1);
+    set_input(avr, 'B', SIM_PIN_B_AXIS_4, 1);
+    set_input(avr, 'D', SIM_PIN_D_X1, 0);
+    set_input(avr, 'D', SIM_PIN_D_X10, 1);
+    set_input(avr, 'D', SIM_PIN_D_X100, 1);
+    set_input(avr, 'D', SIM_PIN_D_RAPID, 1);
+    set_input(avr, 'D', SIM_PIN_D_ESTOP, 0);
+
+    m_enc_a = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), SIM_PIN_C_ENC_AP);
+    m_enc_b = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), SIM_PIN_C_ENC_BP);
+    avr_raise_irq(m_enc_a, 0);
+    avr_raise_irq(m_enc_b, 0);
+
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), SIM_PIN_B_STEP), step_output_hook, avr);
+
+    // four transitions per detent, first one after firmware has had time to initialise
+    m_wheel_period = (avr_cycle_count_t) (avr->frequency / (rate * 4.0));
+    avr_cycle_timer_register(avr, avr_usec_to_cycles(avr, 100000), wheel_timer, NULL);
+}
+
+
+static void print_wheel_report(avr_t* avr) {
+    double us_per_cycle = 1e6 / avr->frequency;
+
+    printf("%u detents, %u steps\n", m_detents, m_steps);
+
+    if ( m_n_latencies ) {
+        printf("wheel-to-step latency over %u detents: min %.1f us, mean %.1f us, max %.1f us\n", m_n_latencies,
+               m_latency_min * us_per_cycle, (double) m_latency_total / m_n_latencies * us_per_cycle,
+               m_latency_max * us_per_cycle);
+    } else {
+        printf("no step output (firmware not built with STANDALONE=1?)\n");
+    }
+}
+
+
+static int open_pty(void) {
+    struct termios tio;
+    int fd;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if ( fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 ) {
+        return -1;
+    }
+
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    return fd;
+}
+
+
+int main(int argc, char* argv[]) {
+    const char* boot_path = NULL;
+    double wheel_rate = 0.0;
+    double duration = 0.0;
+    elf_firmware_t firmware;
+    elf_firmware_t boot;
+    uint32_t uart_flags;
+    uint64_t start_us;
+    uint64_t due;
+    unsigned int n = 0;
+    avr_t* avr;
+    int state;
+    int opt;
+
+    while ( (opt = getopt(argc, argv, "b:w:d:")) != -1 ) {
+        switch(opt) {
+        case 'b':
+            boot_path = optarg;
+            break;
+
+        case 'w':
+            wheel_rate = atof(optarg);
+            break;
+
+        case 'd':
+            duration = atof(optarg);
+            break;
+
+        default:
+            goto usage;
+        }
+    }
+
+    if ( argc - optind != 1 ) {
+        goto usage;
+    }
+
+    memset(&firmware, 0, sizeof(firmware));
+
+    if ( elf_read_firmware(argv[optind], &firmware) != 0 ) {
+        fprintf(stderr, "%s: unable to load firmware\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    if ( !firmware.mmcu[0] ) {
+        strcpy(firmware.mmcu, SIM_MCU);
+    }
+
+    if ( !firmware.frequency ) {
+        firmware.frequency = SIM_FREQ;
+    }
+
+    avr = avr_make_mcu_by_name(firmware.mmcu);
+
+    if ( !avr ) {
+        fprintf(stderr, "%s: unsupported MCU\n", firmware.mmcu);
+        return EXIT_FAILURE;
+    }
+
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+
+    if ( boot_path ) {
+        memset(&boot, 0, sizeof(boot));
+
+        if ( elf_read_firmware(boot_path, &boot) != 0 ) {
+            fprintf(stderr, "%s: unable to load boot loader\n", boot_path);
+            return EXIT_FAILURE;
+        }
+
+        // BOOTRST programmed: reset vector is start of boot section
+        avr_loadcode(avr, boot.flash, boot.flashsize, BOOT_LOADER_START);
+        avr->reset_pc = BOOT_LOADER_START;
+        avr->pc = BOOT_LOADER_START;
+    }
+
+    // bridge USART0 to a pseudo-terminal
+    m_pty = open_pty();
+
+    if ( m_pty < 0 ) {
+        perror("pty");
+        return EXIT_FAILURE;
+    }
+
+    uart_flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &uart_flags);
+    uart_flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &uart_flags);
+
+    m_uart_input = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), uart_output_hook, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XON), uart_xon_hook, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XOFF), uart_xoff_hook, NULL);
+
+    if ( wheel_rate > 0.0 ) {
+        start_wheel(avr, wheel_rate);
+    }
+
+    printf("%s running on %s at %u Hz, USART0 on %s\n", firmware.mmcu, argv[optind], firmware.frequency,
+           ptsname(m_pty));
+    fflush(stdout);
+
+    start_us = mpg_host_now_us();
+
+    do {
+        state = avr_run(avr);
+
+        if ( ++n % SIM_POLL_INTERVAL == 0 ) {
+            pump_input();
+
+            // hold simulation back to real time
+            due = start_us + avr->cycle / (firmware.frequency / 1000000u);
+
+            if ( due > mpg_host_now_us() + 1000u ) {
+                poll(&(struct pollfd) { .fd = m_pty, .events = POLLIN }, 1, 1);
+            }
+        }
+
+        if ( duration > 0.0 && avr->cycle >= (avr_cycle_count_t) (duration * avr->frequency) ) {
+            break;
+        }
+    } while ( state != cpu_Done && state != cpu_Crashed );
+
+    if ( wheel_rate > 0.0 ) {
+        print_wheel_report(avr);
+    }
+
+    avr_terminate(avr);
+
+    return (state == cpu_Done) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+usage:
+    fprintf(stderr, "usage: %s [-b boot.elf] [-w detents_per_s [-d seconds]] firmware.elf\n", argv[0]);
+    return EXIT_FAILURE;
+}
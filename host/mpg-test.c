@@ -0,0 +1,757 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Host-native tests of the firmware modules (built against the register stand-ins in native/).
+ *
+ * Usage: mpg-test
+ *
+ * Covers every quadrature input sequence up to ENCODER_SEQ_LENGTH transitions from every starting state, every
+ * selector switch combination and transition between combinations, and serial command/response framing (including
+ * RS-485 addressing when built with APP_SERIAL_MULTIDROP=1 and step output when built with APP_STEP_STANDALONE=1).
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/eeprom.h>
+#include <avr/io.h>
+
+#include "app-encoder.h"
+#include "app-io.h"
+#include "app-led.h"
+#include "app-serial.h"
+#include "app-step.h"
+#include "app-switch.h"
+#include "boot-loader.h"
+
+
+// length of quadrature input sequences tested exhaustively
+#define ENCODER_SEQ_LENGTH      10
+
+// serial number programmed into simulated EEPROM
+#define TEST_SERIAL_NUMBER      0x12345678UL
+
+// selector switch inputs with no axis selected, x1 and e-stop released (see set_switches())
+#define SWITCHES_IDLE           0xBF
+
+// TIMER0 overflows per LED pattern step (see app-led.c)
+#define LED_STEP_OVERFLOWS      32
+
+// number of failures reported in detail
+#define MAX_REPORTED_FAILURES   20
+
+#define CHECK(cond, ...) \
+    do { \
+        if ( !(cond) ) { \
+            fail(__LINE__, __VA_ARGS__); \
+        } \
+    } while (0)
+
+
+// firmware ISRs (ordinary functions in native builds)
+void TIMER1_OVF_vect(void);
+void USART_RX_vect(void);
+void USART_UDRE_vect(void);
+void USART_TX_vect(void);
+void TIMER1_COMPB_vect(void);
+
+
+static unsigned int m_n_failures;
+
+
+static void fail(int line, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void fail(int line, const char* format, ...) {
+    va_list args;
+
+    if ( ++m_n_failures <= MAX_REPORTED_FAILURES ) {
+        printf("  FAIL (line %d): ", line);
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+        printf("\n");
+    }
+}
+
+
+/**
+ * Sets encoder inputs to quadrature state (bit 0 = A, bit 1 = B).
+ */
+static void set_encoder(uint8_t state) {
+    PINC = (uint8_t) ((PINC & ~((1 << APP_IO_C_ENC_AP) | (1 << APP_IO_C_ENC_BP))) |
+                      ((state & 1) << APP_IO_C_ENC_AP) | (((state >> 1) & 1) << APP_IO_C_ENC_BP));
+}
+
+
+/**
+ * @return  Quarter-step movement from one quadrature state to another (1, -1 or 0), or 2 if both inputs changed.
+ */
+static int quadrature_step(uint8_t from, uint8_t to) {
+    // position of each state (B, A) along the forward sequence 00, 01, 11, 10
+    static const int POSITION[4] = { 0, 1, 3, 2 };
+
+    switch((POSITION[to] - POSITION[from]) & 3) {
+    case 1:     return 1;
+    case 3:     return -1;
+    case 2:     return 2;
+    default:    return 0;
+    }
+}
+
+
+/**
+ * Turns wheel by a number of detents (positive is forward), starting and ending with both inputs low.
+ */
+static void turn_wheel(int detents) {
+    static const uint8_t FORWARD[4] = { 0x1, 0x3, 0x2, 0x0 };
+    static const uint8_t REVERSE[4] = { 0x2, 0x3, 0x1, 0x0 };
+
+    const uint8_t* sequence = (detents >= 0) ? FORWARD : REVERSE;
+    int n = abs(detents);
+    int i;
+
+    for (; n > 0; n--) {
+        for (i = 0; i < 4; i++) {
+            set_encoder(sequence[i]);
+            app_encoder_loop();
+        }
+    }
+}
+
+
+static void test_encoder(void) {
+    unsigned long n_checked = 0;
+    uint8_t sequence[ENCODER_SEQ_LENGTH];
+    uint8_t prev;
+    uint32_t code;
+    int step;
+    int delta;
+    int change;
+    int q;
+    int i;
+    int j;
+    int n;
+
+    printf("encoder: all %d-transition input sequences\n", ENCODER_SEQ_LENGTH);
+
+    for (uint8_t start = 0; start < 4; start++) {
+        for (code = 0; code < (1UL << (2 * ENCODER_SEQ_LENGTH)); code++) {
+            for (i = 0; i < ENCODER_SEQ_LENGTH; i++) {
+                sequence[i] = (code >> (2 * i)) & 3;
+            }
+
+            set_encoder(start);
+            app_encoder_init();
+            app_encoder_reset();
+
+            prev = start;
+            delta = 0;
+            q = 0;
+
+            for (i = 0; i < ENCODER_SEQ_LENGTH; i++) {
+                set_encoder(sequence[i]);
+                app_encoder_loop();
+
+                step = quadrature_step(prev, sequence[i]);
+                change = app_encoder_delta();
+                delta += change;
+                q += (step == 2) ? 0 : step;
+                prev = sequence[i];
+                n_checked++;
+
+                // nothing counted without movement, or when movement cannot be decoded
+                CHECK(change == 0 || (step != 0 && step != 2), "start %u, sequence %05X, transition %d: counted %d "
+                      "without decodable movement", start, (unsigned int) code, i, change);
+
+                // never more than one detent per transition, and only in direction of travel
+                CHECK(change == 0 || change == step, "start %u, sequence %05X, transition %d: counted %d for step %d",
+                      start, (unsigned int) code, i, change, step);
+
+                // counted only on arrival at a detent
+                CHECK(change == 0 || (q & 3) == 0, "start %u, sequence %05X, transition %d: counted %d at %d quarter "
+                      "steps", start, (unsigned int) code, i, change, q);
+
+                // count always within one detent of decoded position
+                CHECK(abs(4 * delta - q) < 4, "start %u, sequence %05X, transition %d: delta %d at %d quarter steps",
+                      start, (unsigned int) code, i, delta, q);
+            }
+        }
+    }
+
+    printf("  %lu transitions checked\n", n_checked);
+
+    // long runs must not drift
+    set_encoder(0);
+    app_encoder_init();
+    app_encoder_reset();
+    turn_wheel(20000);
+    turn_wheel(-20001);
+    delta = app_encoder_delta();
+    CHECK(delta == -1, "20000 detents forward, 20001 back: delta %d", delta);
+
+    // nor must rocking the wheel three quarters of the way towards either neighbouring detent and back
+    for (i = 0; i < 2; i++) {
+        static const uint8_t ROCK[2][6] = {
+                { 0x1, 0x3, 0x2, 0x3, 0x1, 0x0 },
+                { 0x2, 0x3, 0x1, 0x3, 0x2, 0x0 }
+        };
+
+        for (n = 0; n < 1000; n++) {
+            for (j = 0; j < 6; j++) {
+                set_encoder(ROCK[i][j]);
+                app_encoder_loop();
+            }
+        }
+
+        delta = app_encoder_delta();
+        CHECK(delta == 0, "rocking %s: delta %d", i ? "back" : "forward", delta);
+    }
+}
+
+
+/**
+ * Sets selector switch inputs from an 8-bit combination: bits 0-3 are the X, Y, Z and 4 axis inputs, bits 4-5 the x10
+ * and x100 inputs, bit 6 the e-stop input and bit 7 the rapid button input (as read, so low is selected/pressed
+ * except for e-stop).
+ */
+static void set_switches(uint8_t combination) {
+    PINC = (uint8_t) ((PINC & ~((1 << APP_IO_C_AXIS_X) | (1 << APP_IO_C_AXIS_Y))) |
+                      (((combination >> 0) & 1) << APP_IO_C_AXIS_X) | (((combination >> 1) & 1) << APP_IO_C_AXIS_Y));
+
+    PINB = (uint8_t) ((((combination >> 2) & 1) << APP_IO_B_AXIS_Z) | (((combination >> 3) & 1) << APP_IO_B_AXIS_4));
+
+    PIND = (uint8_t) ((((combination >> 4) & 1) << APP_IO_D_X10) | (((combination >> 5) & 1) << APP_IO_D_X100) |
+                      (((combination >> 6) & 1) << APP_IO_D_ESTOP) | (((combination >> 7) & 1) << APP_IO_D_RAPID));
+}
+
+
+static void ref_switches(uint8_t combination, app_switch_state_t* state) {
+    if ( !(combination & 0x01) ) {
+        state->axis = APP_SWITCH_AXIS_X;
+    } else if ( !(combination & 0x02) ) {
+        state->axis = APP_SWITCH_AXIS_Y;
+    } else if ( !(combination & 0x04) ) {
+        state->axis = APP_SWITCH_AXIS_Z;
+    } else if ( !(combination & 0x08) ) {
+        state->axis = APP_SWITCH_AXIS_4;
+    } else {
+        state->axis = APP_SWITCH_AXIS_OFF;
+    }
+
+    if ( !(combination & 0x80) ) {
+        state->step = APP_SWITCH_STEP_X1000;
+    } else if ( !(combination & 0x10) ) {
+        state->step = APP_SWITCH_STEP_X10;
+    } else if ( !(combination & 0x20) ) {
+        state->step = APP_SWITCH_STEP_X100;
+    } else {
+        state->step = APP_SWITCH_STEP_X1;
+    }
+
+    state->e_stop = (combination & 0x40) != 0;
+}
+
+
+/**
+ * Polls switches once (as TIMER1 overflow would).
+ */
+static void poll_switches(uint8_t combination) {
+    set_switches(combination);
+    TIMER1_OVF_vect();
+}
+
+
+/**
+ * Advances LED pattern by one step (as TIMER0 overflows seen by main loop would).
+ *
+ * @return  True if MPG LED is lit.
+ */
+static bool step_led(void) {
+    // nothing happens until TIMER0 overflows
+    TIFR0 = 0;
+    app_led_loop();
+
+    for (int i = 0; i < LED_STEP_OVERFLOWS; i++) {
+        TIFR0 = (1 << TOV0);
+        app_led_loop();
+    }
+
+    return OCR0B != 0;
+}
+
+
+/**
+ * @return  True if pattern is a rotation of expected.
+ */
+static bool is_rotation(uint16_t pattern, uint16_t expected) {
+    for (int i = 0; i < 16; i++) {
+        if ( pattern == (uint16_t) ((expected << i) | (expected >> ((16 - i) & 15))) ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void test_switches(void) {
+    app_switch_state_t expected;
+    app_switch_state_t state;
+    uint16_t led_pattern;
+    uint16_t led_expected;
+    unsigned int a;
+    unsigned int b;
+
+    printf("switches: all combinations and transitions\n");
+
+    for (a = 0; a < 256; a++) {
+        ref_switches((uint8_t) a, &expected);
+
+        // MPG LED flashes slowly, quickly in rapid mode, and is off without an axis
+        led_expected = (expected.axis == APP_SWITCH_AXIS_OFF) ? 0x0000 :
+                       (expected.step == APP_SWITCH_STEP_X1000) ? 0x3333 : 0x00FF;
+        led_pattern = 0;
+
+        for (int i = 0; i < 16; i++) {
+            poll_switches((uint8_t) a);
+            led_pattern = (uint16_t) ((led_pattern << 1) | step_led());
+        }
+
+        app_switch_snapshot(&state);
+
+        CHECK(memcmp(&state, &expected, sizeof(state)) == 0, "combination %02X: axis %u step %u e-stop %d, expected "
+              "axis %u step %u e-stop %d", a, state.axis, state.step, state.e_stop, expected.axis, expected.step,
+              expected.e_stop);
+
+        CHECK(is_rotation(led_pattern, led_expected), "combination %02X: LED pattern %04X, expected %04X", a,
+              led_pattern, led_expected);
+
+        // every transition to every other combination
+        for (b = 0; b < 256; b++) {
+            poll_switches((uint8_t) a);
+            poll_switches((uint8_t) b);
+            app_switch_snapshot(&state);
+            ref_switches((uint8_t) b, &expected);
+
+            CHECK(memcmp(&state, &expected, sizeof(state)) == 0, "combination %02X to %02X: axis %u step %u e-stop %d",
+                  a, b, state.axis, state.step, state.e_stop);
+        }
+    }
+}
+
+
+/**
+ * Receives one character on USART0.
+ */
+static void receive(char c, bool frame_error) {
+    UCSR0A = frame_error ? (1 << FE0) : 0;
+    UDR0 = (uint8_t) c;
+    USART_RX_vect();
+}
+
+
+/**
+ * Sends request characters, prefixed with node address in multi-drop builds.
+ */
+static void send_request(int address, const char* chars, bool frame_error) {
+#if APP_SERIAL_MULTIDROP
+    receive('@', false);
+    receive("0123456789ABCDEF"[address & 0xF], false);
+#else
+    (void) address;
+#endif
+
+    while ( *chars ) {
+        receive(*chars++, frame_error);
+    }
+}
+
+
+/**
+ * Collects response that is being sent, if any.
+ *
+ * @return  Response (empty if none).
+ */
+static const char* drain_response(void) {
+    static char response[64];
+    size_t n = 0;
+
+    // UDRE ISR sends one character per call until response is complete
+    while ( UCSR0B & (1 << UDRIE0) ) {
+#if APP_SERIAL_MULTIDROP
+        CHECK(PORTB & (1 << APP_IO_B_RS485_DE), "RS-485 driver not enabled while sending");
+#endif
+
+        USART_UDRE_vect();
+
+        if ( (UCSR0B & (1 << UDRIE0)) && n < sizeof(response) - 1 ) {
+            response[n++] = (char) UDR0;
+        }
+    }
+
+#if APP_SERIAL_MULTIDROP
+    // bus is released only once last character has been shifted out
+    if ( UCSR0B & (1 << TXCIE0) ) {
+        CHECK(PORTB & (1 << APP_IO_B_RS485_DE), "RS-485 driver released before transmit complete");
+        USART_TX_vect();
+    }
+
+    CHECK(!(PORTB & (1 << APP_IO_B_RS485_DE)), "RS-485 driver not released after response");
+#endif
+
+    response[n] = '\0';
+
+    return response;
+}
+
+
+/**
+ * Sends a request, runs firmware main loop once and collects any response.
+ *
+ * @return  Response (empty if none).
+ */
+static const char* request(int address, const char* chars) {
+    send_request(address, chars, false);
+    app_serial_loop();
+
+    return drain_response();
+}
+
+
+/**
+ * Builds expected response frame (prefixed with node address in multi-drop builds).
+ */
+static const char* frame(int address, const char* format, ...) {
+    static char buffer[64];
+    va_list args;
+    int n = 0;
+
+#if APP_SERIAL_MULTIDROP
+    n = snprintf(buffer, sizeof(buffer), "@%X", address);
+#else
+    (void) address;
+#endif
+
+    va_start(args, format);
+    vsnprintf(&buffer[n], sizeof(buffer) - (size_t) n, format, args);
+    va_end(args);
+
+    return buffer;
+}
+
+
+static void check_response(int line, int address, const char* chars, const char* expected) {
+    const char* response = request(address, chars);
+
+    if ( strcmp(response, expected) != 0 ) {
+        fail(line, "request '%s': response '%s', expected '%s'", chars, response, expected);
+    }
+}
+
+
+static void test_serial(void) {
+    static const int DELTAS[] = { 0, 1, -1, 37, -1000, 32767, -32768 };
+
+    app_switch_state_t state;
+    unsigned int caps;
+    char chars[2] = { 0, 0 };
+    int address = APP_SERIAL_NODE_ADDRESS;
+    unsigned int a;
+    size_t i;
+
+    printf("serial: command framing\n");
+
+    caps = APP_SERIAL_CAP_RESET | APP_SERIAL_CAP_STATUS | APP_SERIAL_CAP_IDENT | APP_SERIAL_CAP_LED;
+    caps |= APP_SERIAL_MULTIDROP ? APP_SERIAL_CAP_MULTIDROP : APP_SERIAL_CAP_BOOT;
+    caps |= APP_STEP_STANDALONE ? APP_SERIAL_CAP_STEP : 0;
+
+    check_response(__LINE__, address, "I", frame(address, "[I%04X%04X%08lX]\r\n", APP_SERIAL_VERSION, caps,
+                   TEST_SERIAL_NUMBER));
+
+    // status frame for every switch combination and a range of encoder deltas (axis is left off so that step output,
+    // if built in, stays idle)
+    for (a = 0; a < 256; a++) {
+        poll_switches((uint8_t) (a | 0x0F));
+        app_switch_snapshot(&state);
+
+        for (i = 0; i < sizeof(DELTAS) / sizeof(DELTAS[0]); i++) {
+            if ( abs(DELTAS[i]) > 1000 && a != 0xFF ) {
+                continue;
+            }
+
+            turn_wheel(DELTAS[i]);
+
+            check_response(__LINE__, address, "S", frame(address, "[S%04X%02X]\r\n", (uint16_t) DELTAS[i],
+                           state.axis | (state.step << 3) | (state.e_stop ? (1 << 5) : 0)));
+        }
+    }
+
+    // reset clears count
+    poll_switches(SWITCHES_IDLE);
+    turn_wheel(3);
+    check_response(__LINE__, address, "R", frame(address, "[R]\r\n"));
+    check_response(__LINE__, address, "S", frame(address, "[S%04X%02X]\r\n", 0, 0x00));
+
+    // characters that are not commands are ignored
+    for (a = 1; a < 256; a++) {
+        if ( strchr("@RSIBLA", (int) a) ) {
+            continue;
+        }
+
+        chars[0] = (char) a;
+        check_response(__LINE__, address, chars, "");
+    }
+
+    // characters received with a framing error are ignored
+    send_request(address, "S", true);
+    app_serial_loop();
+    CHECK(drain_response()[0] == '\0', "response to request with framing error");
+
+    // requests arriving while a response is being sent are ignored
+    send_request(address, "S", false);
+    app_serial_loop();
+    send_request(address, "R", false);
+    CHECK(strcmp(drain_response(), frame(address, "[S%04X%02X]\r\n", 0, 0x00)) == 0, "status response corrupted");
+    check_response(__LINE__, address, "", "");
+
+    // LED patterns, and override of automatic pattern
+    for (chars[0] = '0'; chars[0] <= '7'; chars[0]++) {
+        char led_request[3] = { 'L', chars[0], 0 };
+        check_response(__LINE__, address, led_request, frame(address, "[L]\r\n"));
+    }
+
+    check_response(__LINE__, address, "L2", frame(address, "[L]\r\n"));
+
+    for (i = 0; i < 16; i++) {
+        poll_switches(SWITCHES_IDLE);
+        CHECK(step_led(), "LED off with pattern 'on' selected");
+    }
+
+    check_response(__LINE__, address, "L0", frame(address, "[L]\r\n"));
+
+    for (i = 0; i < 16; i++) {
+        poll_switches(SWITCHES_IDLE);
+        CHECK(!step_led(), "LED on with automatic pattern and no axis selected");
+    }
+
+    check_response(__LINE__, address, "L9", "");
+    check_response(__LINE__, address, "S", frame(address, "[S%04X%02X]\r\n", 0, 0x00));
+
+#if APP_SERIAL_MULTIDROP
+    // requests for other nodes are ignored, and '@' always resynchronises
+    check_response(__LINE__, address + 1, "S", "");
+    receive('@', false);
+    receive('@', false);
+    check_response(__LINE__, address, "S", frame(address, "[S%04X%02X]\r\n", 0, 0x00));
+
+    // boot loader is not reachable over a bus
+    check_response(__LINE__, address, "B", "");
+
+    // address change takes effect immediately, including for acknowledgement, and is kept in EEPROM
+    check_response(__LINE__, address, "A5", frame(5, "[A]\r\n"));
+    CHECK(native_eeprom[APP_SERIAL_EE_NODE_ADDRESS] == 5, "node address not stored");
+    check_response(__LINE__, address, "S", "");
+    check_response(__LINE__, 5, "S", frame(5, "[S%04X%02X]\r\n", 0, 0x00));
+#else
+    // boot request is acknowledged and leaves request flag for boot loader (tested last, as device then resets)
+    check_response(__LINE__, address, "B", frame(address, "[B]\r\n"));
+    CHECK(native_eeprom[BOOT_LOADER_EE_REQUEST] == BOOT_LOADER_REQUEST_MAGIC, "boot request flag not set");
+#endif
+}
+
+
+#if APP_STEP_STANDALONE
+
+/**
+ * Runs step output until it comes to rest, with each compare match taken on time.
+ *
+ * @param latency       Delay from each compare match to its handler running (as other interrupts would cause), in
+ *                      timer ticks.
+ * @param min_period    Shortest period between rising edges, in timer ticks.
+ * @param max_wait      Longest time from one compare match to the next, in timer ticks.
+ *
+ * @return  Net number of steps output (positive is DIR high).
+ */
+static long run_steps(uint16_t latency, uint32_t* min_period, uint32_t* max_wait) {
+    uint64_t now = 0;
+    uint64_t last_rise = 0;
+    long steps = 0;
+    bool high = false;
+    uint16_t wait;
+
+    *min_period = UINT32_MAX;
+    *max_wait = 0;
+
+    while ( TIMSK1 & (1 << OCIE1B) ) {
+        wait = (uint16_t) (OCR1B - TCNT1);
+        now += wait;
+        TCNT1 = OCR1B;
+
+        if ( wait > *max_wait ) {
+            *max_wait = wait;
+        }
+
+        high = !high;
+
+        if ( high ) {
+            steps += (PORTB & (1 << APP_IO_B_DIR)) ? 1 : -1;
+
+            if ( last_rise && now - last_rise < *min_period ) {
+                *min_period = (uint32_t) (now - last_rise);
+            }
+
+            last_rise = now;
+        }
+
+        TCNT1 += latency;
+        now += latency;
+        TIMER1_COMPB_vect();
+    }
+
+    return steps;
+}
+
+
+static void test_step(void) {
+    static const long SCALE[4] = { 1, 10, 100, 1000 };
+
+    uint32_t min_period;
+    uint32_t max_wait;
+    long steps;
+
+    printf("step: output per detent, direction and rate\n");
+
+    app_encoder_delta();
+
+    for (uint8_t step = 0; step < 4; step++) {
+        // X axis, each step size
+        poll_switches((uint8_t) (SWITCHES_IDLE & ~(0x01 | (step == 1 ? 0x10 : step == 2 ? 0x20 : step == 3 ? 0x80 : 0))));
+
+        for (int detents = -3; detents <= 3; detents += 6) {
+            turn_wheel(detents);
+            steps = run_steps(0, &min_period, &max_wait);
+
+            CHECK(steps == detents * SCALE[step] * APP_STEP_PER_DETENT, "step size %u, %d detents: %ld steps", step,
+                  detents, steps);
+
+            CHECK(min_period >= (F_CPU / 8) / APP_STEP_MAX_RATE, "step size %u: period %u ticks exceeds maximum rate",
+                  step, min_period);
+        }
+    }
+
+    // no output for other axes, or while e-stop is pressed
+    poll_switches(SWITCHES_IDLE & ~0x02);
+    turn_wheel(5);
+    CHECK(run_steps(0, &min_period, &max_wait) == 0, "steps output with another axis selected");
+
+    poll_switches((SWITCHES_IDLE & ~0x01) | 0x40);
+    turn_wheel(5);
+    CHECK(run_steps(0, &min_period, &max_wait) == 0, "steps output with e-stop pressed");
+
+    // reversing part way through a move loses no steps
+    poll_switches(SWITCHES_IDLE & ~(0x01 | 0x20));
+    turn_wheel(5);
+
+    for (int i = 0; i < 100; i++) {
+        TCNT1 = OCR1B;
+        TIMER1_COMPB_vect();
+    }
+
+    turn_wheel(-5);
+    steps = 50 + run_steps(0, &min_period, &max_wait);
+    CHECK(steps == 0, "reversal: net %ld steps", steps);
+
+    // handler held up past the next edge time (here by more than half a period at full rate) outputs that edge late
+    // rather than waiting for TIMER1 to wrap
+    poll_switches(SWITCHES_IDLE & ~(0x01 | 0x80));
+    turn_wheel(3);
+    steps = run_steps((F_CPU / 8) / APP_STEP_MAX_RATE / 2 + 20, &min_period, &max_wait);
+    CHECK(steps == 3000 * APP_STEP_PER_DETENT, "late handler: %ld steps", steps);
+    CHECK(max_wait < 0x8000, "late handler: output stalled for %u ticks", max_wait);
+    CHECK(min_period >= (F_CPU / 8) / APP_STEP_MAX_RATE, "late handler: period %u ticks exceeds maximum rate",
+          min_period);
+
+    poll_switches(SWITCHES_IDLE);
+    app_encoder_delta();
+}
+
+#endif
+
+
+int main(void) {
+    // serial number is read from EEPROM at start-up
+    eeprom_update_dword((uint32_t*) APP_SERIAL_EE_SERIAL_NUMBER, TEST_SERIAL_NUMBER);
+
+    app_io_init();
+
+#if APP_SERIAL_MULTIDROP
+    // a resetting node must not drive the shared bus, even before serial module is initialised
+    CHECK((DDRB & (1 << APP_IO_B_RS485_DE)) && !(PORTB & (1 << APP_IO_B_RS485_DE)),
+          "RS-485 driver not disabled by port set-up");
+#endif
+
+#if APP_STEP_STANDALONE
+    // STEP must not be pulled high between reset and step module initialisation, or driver sees a step
+    CHECK((DDRB & (1 << APP_IO_B_STEP)) && !(PORTB & (1 << APP_IO_B_STEP)) && (DDRB & (1 << APP_IO_B_DIR)) &&
+          !(PORTB & (1 << APP_IO_B_DIR)), "STEP/DIR not held low by port set-up");
+#endif
+
+    poll_switches(SWITCHES_IDLE);
+    set_encoder(0);
+
+    app_led_init();
+    app_encoder_init();
+    app_switch_init();
+    app_serial_init();
+
+#if APP_STEP_STANDALONE
+    app_step_init();
+#endif
+
+    poll_switches(SWITCHES_IDLE);
+
+    test_encoder();
+    test_switches();
+
+#if APP_STEP_STANDALONE
+    test_step();
+#endif
+
+    // serial tests last, as boot request leaves firmware waiting for reset
+    set_encoder(0);
+    app_encoder_init();
+    app_encoder_reset();
+    test_serial();
+
+    printf("%s (%u failures)\n", m_n_failures ? "FAIL" : "PASS", m_n_failures);
+
+    return m_n_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Native stand-in for avr-libc's <avr/eeprom.h>, backed by native_eeprom[] (erased to 0xFF at start-up).
+ */
+#ifndef _NATIVE_AVR_EEPROM_H_
+#define _NATIVE_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+// ATmega328P EEPROM size, in bytes
+#define NATIVE_EEPROM_SIZE      1024
+
+extern uint8_t native_eeprom[NATIVE_EEPROM_SIZE];
+
+
+static inline uint8_t eeprom_read_byte(const uint8_t* address) {
+    return native_eeprom[(uintptr_t) address];
+}
+
+
+static inline uint32_t eeprom_read_dword(const uint32_t* address) {
+    uint32_t value;
+
+    // little-endian, as on AVR
+    memcpy(&value, &native_eeprom[(uintptr_t) address], sizeof(value));
+
+    return value;
+}
+
+
+static inline void eeprom_update_byte(uint8_t* address, uint8_t value) {
+    native_eeprom[(uintptr_t) address] = value;
+}
+
+
+static inline void eeprom_update_dword(uint32_t* address, uint32_t value) {
+    memcpy(&native_eeprom[(uintptr_t) address], &value, sizeof(value));
+}
+
+#endif // _NATIVE_AVR_EEPROM_H_
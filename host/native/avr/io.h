@@ -0,0 +1,146 @@
+/*
+ * MPG-Nano - Firmware and UCCNC plugin for Arduino Nano based serial-over-USB
+ * interface for modified 4-axis Chinese MPG pendant.
+ *
+ * https://github.com/mattbucknall/mpg-nano
+ *
+ * Copyright (c) 2021 Matthew T. Bucknall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISIN
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Native stand-in for avr-libc's <avr/io.h>, so that firmware modules build and run on the host. The ATmega328P
+ * registers used by the firmware are plain variables (defined in native-avr.c): tests drive inputs by assigning PINx,
+ * UDR0 etc. before calling a module function or ISR, and observe outputs by reading PORTx, OCRxx, UDR0 etc. after.
+ * Hardware side effects (flag clearing, OC pin toggling, pin toggling through PINx writes) are not modelled.
+ */
+#ifndef _NATIVE_AVR_IO_H_
+#define _NATIVE_AVR_IO_H_
+
+#include <stdint.h>
+
+// status register
+extern volatile uint8_t SREG;
+
+// GPIO
+extern volatile uint8_t PINB;
+extern volatile uint8_t PINC;
+extern volatile uint8_t PIND;
+extern volatile uint8_t PORTB;
+extern volatile uint8_t PORTC;
+extern volatile uint8_t PORTD;
+extern volatile uint8_t DDRB;
+extern volatile uint8_t DDRC;
+extern volatile uint8_t DDRD;
+
+// TIMER0
+extern volatile uint8_t TCCR0A;
+extern volatile uint8_t TCCR0B;
+extern volatile uint8_t TCNT0;
+extern volatile uint8_t OCR0A;
+extern volatile uint8_t OCR0B;
+extern volatile uint8_t TIMSK0;
+extern volatile uint8_t TIFR0;
+
+// TIMER1
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TCCR1C;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+extern volatile uint8_t TIMSK1;
+extern volatile uint8_t TIFR1;
+
+// USART0
+extern volatile uint8_t UCSR0A;
+extern volatile uint8_t UCSR0B;
+extern volatile uint8_t UCSR0C;
+extern volatile uint16_t UBRR0;
+extern volatile uint8_t UDR0;
+
+// SREG bits
+#define SREG_I      7
+
+// TCCR0A bits
+#define COM0A1      7
+#define COM0A0      6
+#define COM0B1      5
+#define COM0B0      4
+#define WGM01       1
+#define WGM00       0
+
+// TCCR0B bits
+#define WGM02       3
+#define CS02        2
+#define CS01        1
+#define CS00        0
+
+// TIFR0 bits
+#define TOV0        0
+
+// TCCR1A bits
+#define COM1A1      7
+#define COM1A0      6
+#define COM1B1      5
+#define COM1B0      4
+#define WGM11       1
+#define WGM10       0
+
+// TCCR1B bits
+#define WGM13       4
+#define WGM12       3
+#define CS12        2
+#define CS11        1
+#define CS10        0
+
+// TIMSK1 bits
+#define OCIE1B      2
+#define OCIE1A      1
+#define TOIE1       0
+
+// TIFR1 bits
+#define OCF1B       2
+#define OCF1A       1
+#define TOV1        0
+
+// UCSR0A bits
+#define RXC0        7
+#define TXC0        6
+#define UDRE0       5
+#define FE0         4
+#define DOR0        3
+#define UPE0        2
+#define U2X0        1
+#define MPCM0       0
+
+// UCSR0B bits
+#define RXCIE0      7
+#define TXCIE0      6
+#define UDRIE0      5
+#define RXEN0       4
+#define TXEN0       3
+#define UCSZ02      2
+
+// UCSR0C bits
+#define UCSZ01      2
+#define UCSZ00      1
+
+#endif // _NATIVE_AVR_IO_H_
@@ -32,7 +32,9 @@
 
 #include "app-encoder.h"
 #include "app-io.h"
+#include "app-led.h"
 #include "app-serial.h"
+#include "app-step.h"
 #include "app-switch.h"
 
 
@@ -42,8 +44,6 @@
  * @note Never returns.
  */
 int main(void) {
-    static uint16_t heart_beat;
-
     // enable watchdog timer
     wdt_enable(WDTO_250MS);
 
@@ -52,25 +52,32 @@ int main(void) {
 
     // initialise modules
     app_io_init();
+    app_led_init();
     app_encoder_init();
     app_switch_init();
     app_serial_init();
 
+#if APP_STEP_STANDALONE
+    app_step_init();
+#endif
+
     // enable interrupts globally
     sei();
 
     // enter main loop
     for (;;) {
-        // toggle Nano LED every time heart_beat counter rolls over
-        if ( heart_beat++ == 0 ) {
-            PINB = (1 << APP_IO_B_NANO_LED);
-        }
-
         // reset watchdog
         wdt_reset();
 
         // handle serial comms
         app_serial_loop();
         app_encoder_loop();
+
+        // advance LED patterns
+        app_led_loop();
+
+#if APP_STEP_STANDALONE
+        app_step_loop();
+#endif
     }
 }